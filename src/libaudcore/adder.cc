@@ -68,9 +68,15 @@ struct AddResult : public ListNode
     String title;
     Index<PlaylistAddItem> items;
     bool saw_folder, filtered;
+
+    /* set if part of the result has already been sent (see send_chunk) */
+    bool continued;
+    bool partial; /* set if more of the result is to follow */
+    int n_found;  /* including files already sent */
 };
 
 static void add_worker();
+static void add_finish();
 
 static List<AddTask> add_tasks;
 static List<AddResult> add_results;
@@ -136,11 +142,42 @@ static void status_done_locked()
     }
 }
 
+/*
+ * Adding a large folder can take minutes.  Rather than waiting for the whole
+ * result, files are sent to the playlist in chunks of "add_chunk_size" as
+ * they are found.  Each chunk is inserted after the last entry of the previous
+ * one (wherever that has been moved to), so the files keep their order even if
+ * the playlist is edited in between.
+ */
+static void send_chunk(AddResult * result)
+{
+    AddResult * chunk = new AddResult();
+
+    chunk->playlist = result->playlist;
+    chunk->at = result->at;
+    chunk->play = result->play;
+    chunk->title = std::move(result->title);
+    chunk->items = std::move(result->items);
+    chunk->continued = result->continued;
+    chunk->partial = true;
+
+    /* only the first chunk starts playback or sets the title */
+    result->play = false;
+    result->continued = true;
+
+    auto mh = mutex.take();
+
+    if (!add_results.head())
+        queued_add.queue(add_finish);
+
+    add_results.append(chunk);
+}
+
 static void add_file(PlaylistAddItem && item, Playlist::FilterFunc filter,
                      void * user, AddResult * result, bool skip_invalid)
 {
     AUDINFO("Adding file: %s\n", (const char *)item.filename);
-    status_update(item.filename, result->items.len());
+    status_update(item.filename, result->n_found);
 
     /*
      * If possible, we'll wait until the file is added to the playlist to probe
@@ -218,7 +255,14 @@ static void add_file(PlaylistAddItem && item, Playlist::FilterFunc filter,
         }
     }
     else
+    {
         result->items.append(std::move(item));
+        result->n_found++;
+
+        int chunk_size = aud_get_int("add_chunk_size");
+        if (chunk_size > 0 && result->items.len() >= chunk_size)
+            send_chunk(result);
+    }
 }
 
 /* To prevent infinite recursion, we currently allow adding a folder from within
@@ -233,7 +277,7 @@ static void add_playlist(const char * filename, Playlist::FilterFunc filter,
                          void * user, AddResult * result, bool save_title)
 {
     AUDINFO("Adding playlist: %s\n", filename);
-    status_update(filename, result->items.len());
+    status_update(filename, result->n_found);
 
     String title;
     Index<PlaylistAddItem> items;
@@ -273,7 +317,7 @@ static void add_cuesheets(Index<String> & files, Playlist::FilterFunc filter,
     for (String & cuesheet : cuesheets)
     {
         AUDINFO("Adding cuesheet: %s\n", (const char *)cuesheet);
-        status_update(cuesheet, result->items.len());
+        status_update(cuesheet, result->n_found);
 
         String title; // ignored
         Index<PlaylistAddItem> items;
@@ -306,22 +350,218 @@ static void add_cuesheets(Index<String> & files, Playlist::FilterFunc filter,
     }
 }
 
-static void add_folder(const char * filename, Playlist::FilterFunc filter,
-                       void * user, AddResult * result, bool save_title)
+/*
+ * Reading a folder and testing each of its entries is slow on network shares,
+ * mostly due to latency.  To hide it, folders are scanned by a pool of threads
+ * (FolderWalker) ahead of the add thread, which still visits them one at a
+ * time in the same order as before (files first, then subfolders), so that the
+ * result does not depend on which scan finishes first.
+ *
+ * Without a filter, each scanned folder queues its own subfolders, so that the
+ * whole tree is scanned in parallel.  With a filter, subfolders are queued by
+ * the add thread once they have passed the filter, since the filter function
+ * may not be safe to call from other threads.
+ */
+
+#define FOLDER_THREADS 8
+
+struct FolderScan : public ListNode
 {
-    AUDINFO("Adding folder: %s\n", filename);
-    status_update(filename, result->items.len());
+    String filename;
+    bool ready = false;
 
     String error;
-    Index<String> files = VFSFile::read_folder(filename, error);
+    bool empty = false;
+    Index<String> files;
     Index<String> folders;
+    Index<FolderScan *> children; /* queued subfolders */
+
+    explicit FolderScan(const String & filename) : filename(filename) {}
+};
+
+class FolderWalker
+{
+public:
+    explicit FolderWalker(bool queue_subfolders)
+        : m_queue_subfolders(queue_subfolders)
+    {
+    }
+
+    ~FolderWalker();
+
+    FolderScan * queue(const String & filename);
+    void wait(FolderScan * scan);
+    void release(FolderScan * scan);
+
+    bool queues_subfolders() const { return m_queue_subfolders; }
+
+private:
+    const bool m_queue_subfolders;
+
+    aud::mutex m_mutex;
+    aud::condvar m_work_cond, m_ready_cond;
+
+    List<FolderScan> m_scans;        /* all scans not yet released */
+    Index<FolderScan *> m_pending;   /* used as a stack */
+    std::thread m_threads[FOLDER_THREADS];
+    int m_n_threads = 0, m_n_idle = 0;
+    bool m_quit = false;
+
+    FolderScan * queue_locked(const String & filename);
+    void run();
+};
+
+static void scan_folder(FolderScan * scan, bool recurse)
+{
+    auto test = VFSFileTest(VFS_IS_REGULAR | VFS_IS_SYMLINK | VFS_IS_DIR);
+    auto entries = VFSFile::read_folder(scan->filename, test, scan->error);
+
+    if (!entries.len())
+    {
+        scan->empty = true;
+        return;
+    }
+
+    for (auto & entry : entries)
+    {
+        VFSFileTest mode = entry.mode;
+
+        // cuesheets are handled later on, whatever they turn out to be
+        if (str_has_suffix_nocase(entry.filename, ".cue"))
+        {
+            scan->files.append(std::move(entry.filename));
+            continue;
+        }
+
+        // to prevent infinite recursion, skip symlinks to folders
+        if ((mode & (VFS_IS_SYMLINK | VFS_IS_DIR)) ==
+            (VFS_IS_SYMLINK | VFS_IS_DIR))
+            continue;
+
+        if (mode & VFS_IS_REGULAR)
+            scan->files.append(std::move(entry.filename));
+        else if ((mode & VFS_IS_DIR) && recurse)
+            scan->folders.append(std::move(entry.filename));
+    }
+
+    // sort folder list in natural order
+    scan->folders.sort(str_compare_encoded);
+}
+
+FolderWalker::~FolderWalker()
+{
+    auto mh = m_mutex.take();
+
+    m_quit = true;
+    m_work_cond.notify_all();
+
+    mh.unlock();
+
+    for (int i = 0; i < m_n_threads; i++)
+        m_threads[i].join();
+
+    m_scans.clear();
+}
+
+FolderScan * FolderWalker::queue_locked(const String & filename)
+{
+    auto scan = new FolderScan(filename);
+
+    m_scans.append(scan);
+    m_pending.append(scan);
+
+    if (m_n_idle)
+        m_work_cond.notify_one();
+    else if (m_n_threads < FOLDER_THREADS)
+        m_threads[m_n_threads++] = std::thread(&FolderWalker::run, this);
+
+    return scan;
+}
+
+FolderScan * FolderWalker::queue(const String & filename)
+{
+    auto mh = m_mutex.take();
+    return queue_locked(filename);
+}
+
+void FolderWalker::wait(FolderScan * scan)
+{
+    auto mh = m_mutex.take();
+
+    while (!scan->ready)
+        m_ready_cond.wait(mh);
+}
+
+void FolderWalker::release(FolderScan * scan)
+{
+    auto mh = m_mutex.take();
+
+    m_scans.remove(scan);
+    delete scan;
+}
+
+void FolderWalker::run()
+{
+    auto mh = m_mutex.take();
+
+    while (true)
+    {
+        if (m_quit)
+            break;
 
-    if (error)
+        if (!m_pending.len())
+        {
+            m_n_idle++;
+            m_work_cond.wait(mh);
+            m_n_idle--;
+            continue;
+        }
+
+        /* The most recently queued folders are scanned first, which is
+         * roughly the order in which the add thread will need them. */
+        FolderScan * scan = m_pending[m_pending.len() - 1];
+        m_pending.remove(m_pending.len() - 1, 1);
+        bool recurse = aud_get_bool("recurse_folders");
+
+        mh.unlock();
+        scan_folder(scan, recurse);
+        mh.lock();
+
+        if (m_queue_subfolders)
+        {
+            /* queue in reverse, so that the first subfolder is on top */
+            int n_folders = scan->folders.len();
+            scan->children.insert(0, n_folders);
+
+            for (int i = n_folders; i--;)
+                scan->children[i] = queue_locked(scan->folders[i]);
+        }
+
+        scan->ready = true;
+        m_ready_cond.notify_all();
+    }
+}
+
+static void add_scanned_folder(FolderWalker & walker, FolderScan * scan,
+                               Playlist::FilterFunc filter, void * user,
+                               AddResult * result, bool save_title)
+{
+    const char * filename = scan->filename;
+
+    AUDINFO("Adding folder: %s\n", filename);
+    status_update(filename, result->n_found);
+
+    walker.wait(scan);
+
+    if (scan->error)
         aud_ui_show_error(str_printf(_("Error reading %s:\n%s"), filename,
-                                     (const char *)error));
+                                     (const char *)scan->error));
 
-    if (!files.len())
+    if (scan->empty)
+    {
+        walker.release(scan);
         return;
+    }
 
     if (save_title)
     {
@@ -330,12 +570,28 @@ static void add_folder(const char * filename, Playlist::FilterFunc filter,
             result->title = String(str_decode_percent(slash + 1));
     }
 
-    add_cuesheets(files, filter, user, result);
+    Index<FolderScan *> children;
+
+    if (walker.queues_subfolders())
+        children = std::move(scan->children);
+    else
+    {
+        // queue subfolders right away, to be scanned while adding files
+        for (const String & folder : scan->folders)
+        {
+            if (filter && !filter(folder, user))
+                result->filtered = true;
+            else
+                children.append(walker.queue(folder));
+        }
+    }
+
+    add_cuesheets(scan->files, filter, user, result);
 
     // sort file list in natural order (must come after add_cuesheets)
-    files.sort(str_compare_encoded);
+    scan->files.sort(str_compare_encoded);
 
-    for (const String & file : files)
+    for (String & file : scan->files)
     {
         if (filter && !filter(file, user))
         {
@@ -343,28 +599,22 @@ static void add_folder(const char * filename, Playlist::FilterFunc filter,
             continue;
         }
 
-        String error;
-        VFSFileTest mode = VFSFile::test_file(
-            file, VFSFileTest(VFS_IS_REGULAR | VFS_IS_SYMLINK | VFS_IS_DIR),
-            error);
-
-        if (error)
-            AUDERR("%s: %s\n", (const char *)file, (const char *)error);
-
-        // to prevent infinite recursion, skip symlinks to folders
-        if ((mode & (VFS_IS_SYMLINK | VFS_IS_DIR)) ==
-            (VFS_IS_SYMLINK | VFS_IS_DIR))
-            continue;
-
-        if (mode & VFS_IS_REGULAR)
-            add_file({file}, filter, user, result, true);
-        else if ((mode & VFS_IS_DIR) && aud_get_bool("recurse_folders"))
-            folders.append(file);
+        add_file({std::move(file)}, filter, user, result, true);
     }
 
+    walker.release(scan);
+
     // add folders after files
-    for (const String & folder : folders)
-        add_folder(folder, filter, user, result, false);
+    for (FolderScan * child : children)
+        add_scanned_folder(walker, child, filter, user, result, false);
+}
+
+static void add_folder(const char * filename, Playlist::FilterFunc filter,
+                       void * user, AddResult * result, bool save_title)
+{
+    FolderWalker walker(!filter);
+    add_scanned_folder(walker, walker.queue(String(filename)), filter, user,
+                       result, save_title);
 }
 
 static void add_generic(PlaylistAddItem && item, Playlist::FilterFunc filter,
@@ -447,12 +697,16 @@ static void stop_thread_locked()
 static void add_finish()
 {
     auto mh = mutex.take();
+    bool complete = false;
 
     for (SmartPtr<AddResult> result; result.capture(add_results.pop_head());)
     {
+        if (!result->partial)
+            complete = true;
+
         if (!result->items.len())
         {
-            if (result->saw_folder && !result->filtered)
+            if (result->saw_folder && !result->filtered && !result->continued)
                 aud_ui_show_error(_("No files found."));
             continue;
         }
@@ -470,8 +724,6 @@ static void add_finish()
         }
 
         int count = playlist.n_entries();
-        if (result->at < 0 || result->at > count)
-            result->at = count;
 
         if (result->title && !count)
         {
@@ -483,7 +735,8 @@ static void add_finish()
          * scanning until the currently playing entry is known, at which time it
          * can be scanned more efficiently (album art read in the same pass). */
         playlist_enable_scan(false);
-        playlist.insert_flat_items(result->at, std::move(result->items));
+        result->at = playlist.insert_flat_items(
+            result->at, std::move(result->items), result->continued);
 
         if (result->play)
         {
@@ -504,7 +757,9 @@ static void add_finish()
 
     mh.unlock(); // before calling hook
 
-    hook_call("playlist add complete", nullptr);
+    /* not called for chunks sent before the whole result is ready */
+    if (complete)
+        hook_call("playlist add complete", nullptr);
 }
 
 static void add_worker()
@@ -22,10 +22,13 @@
 #include <string.h>
 
 #include <glib.h> /* for g_dir_open, g_file_test */
+#include <glib/gstdio.h>
 
 #include "audstrings.h"
 #include "index.h"
+#include "multihash.h"
 #include "runtime.h"
+#include "threads.h"
 
 struct SearchParams
 {
@@ -58,75 +61,135 @@ static bool cover_name_filter(const char * name, const Index<String> & keywords,
     return false;
 }
 
-static String fileinfo_recursive_get_image(const char * path,
-                                           const SearchParams * params,
-                                           int depth)
+/*
+ * Every song of an album is searched for separately, usually in the same
+ * directory, so the relevant parts of each directory listing are cached.  A
+ * listing is read again if the modification time of the directory changes
+ * (that is, if files are added, removed, or renamed).
+ */
+struct DirListing
+{
+    int64_t mtime;
+    Index<String> images;  /* files with an image extension */
+    Index<String> subdirs; /* only filled if has_subdirs is set */
+    bool has_subdirs;
+};
+
+/* an arbitrary limit, so that the cache is not allowed to grow forever */
+#define MAX_LISTINGS 256
+
+static aud::mutex mutex;
+static SimpleHash<String, DirListing> listings;
+
+static DirListing read_listing(const char * path, int64_t mtime,
+                               bool with_subdirs)
 {
+    DirListing listing{mtime, {}, {}, with_subdirs};
+
     GDir * d = g_dir_open(path, 0, nullptr);
     if (!d)
-        return String();
+        return listing;
 
     const char * name;
+    while ((name = g_dir_read_name(d)))
+    {
+        bool image = has_front_cover_extension(name);
 
+        if (!image && !with_subdirs)
+            continue;
+
+        StringBuf newpath = filename_build({path, name});
+
+        if (g_file_test(newpath, G_FILE_TEST_IS_DIR))
+        {
+            if (with_subdirs)
+                listing.subdirs.append(name);
+        }
+        else if (image)
+            listing.images.append(name);
+    }
+
+    g_dir_close(d);
+    return listing;
+}
+
+static String match_image(const DirListing & listing,
+                          const SearchParams * params, int depth)
+{
     if (aud_get_bool("use_file_cover") && !depth)
     {
         /* Look for images matching file name */
-        while ((name = g_dir_read_name(d)))
+        for (const String & name : listing.images)
         {
-            StringBuf newpath = filename_build({path, name});
-
-            if (has_front_cover_extension(name) &&
-                same_basename(name, params->filename) &&
-                !g_file_test(newpath, G_FILE_TEST_IS_DIR))
-            {
-                g_dir_close(d);
-                return String(newpath);
-            }
+            if (same_basename(name, params->filename))
+                return name;
         }
-
-        g_dir_rewind(d);
     }
 
     /* Search for files using filter */
-    while ((name = g_dir_read_name(d)))
+    for (const String & name : listing.images)
     {
-        StringBuf newpath = filename_build({path, name});
+        if (cover_name_filter(name, params->include, true) &&
+            !cover_name_filter(name, params->exclude, false))
+            return name;
+    }
+
+    return String();
+}
+
+static String fileinfo_recursive_get_image(const char * path,
+                                           const SearchParams * params,
+                                           int depth)
+{
+    GStatBuf info;
+    if (g_stat(path, &info) < 0)
+        return String();
 
-        if (has_front_cover_extension(name) &&
-            cover_name_filter(name, params->include, true) &&
-            !cover_name_filter(name, params->exclude, false) &&
-            !g_file_test(newpath, G_FILE_TEST_IS_DIR))
+    bool recurse = aud_get_bool("recurse_for_cover") &&
+                   depth < aud_get_int("recurse_for_cover_depth");
+
+    String key(path);
+    Index<String> subdirs;
+
+    {
+        auto mh = mutex.take();
+        DirListing * listing = listings.lookup(key);
+
+        if (!listing || listing->mtime != (int64_t)info.st_mtime ||
+            (recurse && !listing->has_subdirs))
         {
-            g_dir_close(d);
-            return String(newpath);
+            /* don't block other threads while reading */
+            mh.unlock();
+            DirListing fresh = read_listing(path, info.st_mtime, recurse);
+            mh.lock();
+
+            if (listings.n_items() >= MAX_LISTINGS)
+                listings.clear();
+
+            listing = listings.add(key, std::move(fresh));
         }
-    }
 
-    g_dir_rewind(d);
+        String name = match_image(*listing, params, depth);
+        if (name)
+            return String(filename_build({path, name}));
 
-    if (aud_get_bool("recurse_for_cover") &&
-        depth < aud_get_int("recurse_for_cover_depth"))
-    {
-        /* Descend into directories recursively. */
-        while ((name = g_dir_read_name(d)))
+        if (recurse)
         {
-            StringBuf newpath = filename_build({path, name});
-
-            if (g_file_test(newpath, G_FILE_TEST_IS_DIR))
-            {
-                String tmp =
-                    fileinfo_recursive_get_image(newpath, params, depth + 1);
-
-                if (tmp)
-                {
-                    g_dir_close(d);
-                    return tmp;
-                }
-            }
+            for (const String & subdir : listing->subdirs)
+                subdirs.append(subdir);
         }
     }
 
-    g_dir_close(d);
+    /* Descend into directories recursively. */
+    for (const String & subdir : subdirs)
+    {
+        StringBuf newpath = filename_build({path, subdir});
+        String tmp = fileinfo_recursive_get_image(newpath, params, depth + 1);
+
+        if (tmp)
+            return tmp;
+    }
+
     return String();
 }
 
@@ -151,3 +214,9 @@ String art_search(const char * filename)
     String image_local = fileinfo_recursive_get_image(local, &params, 0);
     return image_local ? String(filename_to_uri(image_local)) : String();
 }
+
+void art_search_cleanup()
+{
+    auto mh = mutex.take();
+    listings.clear();
+}
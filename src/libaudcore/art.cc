@@ -29,6 +29,7 @@
 
 #include "audstrings.h"
 #include "hook.h"
+#include "list.h"
 #include "mainloop.h"
 #include "multihash.h"
 #include "runtime.h"
@@ -36,14 +37,36 @@
 #include "threads.h"
 #include "vfs.h"
 
+#ifdef S_IRGRP
+#define DIRMODE (S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH)
+#else
+#define DIRMODE (S_IRWXU)
+#endif
+
 #define FLAG_DONE 1
 #define FLAG_SENT 2
 
-struct AudArtItem
+/* rough size of an item, not counting the image data */
+#define ITEM_OVERHEAD 256
+
+/* thumbnails are stored in these sizes (in pixels) */
+#define THUMB_MIN_SIZE 32
+#define THUMB_MAX_SIZE 512
+
+/* The header of a thumbnail file holds the magic, the modification times (in
+ * nanoseconds) of the song file and of the image file, and the length of the
+ * image file URI, which follows it (empty for embedded album art). */
+#define THUMB_MAGIC "AudThmb2"
+#define THUMB_HEADER_SIZE 28
+#define THUMB_MAX_URI 4096
+
+struct AudArtItem : public ListNode
 {
+    String key; /* filename, or see thumb_key() */
     String filename;
     int refcount;
     int flag;
+    bool stale; /* to be removed when no longer referenced */
 
     /* album art as JPEG or PNG data */
     Index<char> data;
@@ -58,6 +81,16 @@ static SimpleHash<String, AudArtItem> art_items;
 static AudArtItem * current_item;
 static QueuedFunc queued_requests;
 
+/*
+ * Finished items are kept after the last reference is dropped, so that
+ * scrolling back through a list of albums does not read the same files again.
+ * Unreferenced items are kept in least-recently-used order and removed once
+ * their total size exceeds "art_cache_size" (in MiB).  Items for songs with
+ * no album art are cached too.
+ */
+static List<AudArtItem> unused_items;
+static int64_t unused_bytes;
+
 static Index<AudArtItem *> get_queued()
 {
     auto mh = mutex.take();
@@ -110,8 +143,71 @@ static void request_callback(ScanRequest * request)
                     std::move(request->image_file));
 }
 
-static AudArtItem * art_item_get(aud::mutex::holder &, const String & filename,
-                                 bool * queued)
+static int64_t item_size(const AudArtItem * item)
+{
+    return ITEM_OVERHEAD + item->data.len();
+}
+
+static AudArtItem * art_item_add(aud::mutex::holder &, const String & key,
+                                 const String & filename)
+{
+    AudArtItem * item = art_items.add(key, AudArtItem());
+    item->key = key;
+    item->filename = filename;
+    item->refcount = 1;
+    return item;
+}
+
+static void art_item_delete(aud::mutex::holder &, AudArtItem * item)
+{
+    /* delete temporary file */
+    if (item->art_file && item->is_temp)
+    {
+        StringBuf local = uri_to_filename(item->art_file);
+        if (local)
+            g_unlink(local);
+    }
+
+    art_items.remove(item->key);
+}
+
+static void trim_cache(aud::mutex::holder & mh, int64_t limit)
+{
+    AudArtItem * item;
+    while (unused_bytes > limit && (item = unused_items.head()))
+    {
+        unused_items.remove(item);
+        unused_bytes -= item_size(item);
+        art_item_delete(mh, item);
+    }
+}
+
+static void art_item_ref(aud::mutex::holder &, AudArtItem * item)
+{
+    if (!item->refcount++)
+    {
+        unused_items.remove(item);
+        unused_bytes -= item_size(item);
+    }
+}
+
+static void art_item_unref(aud::mutex::holder & mh, AudArtItem * item)
+{
+    if (!--item->refcount)
+    {
+        if (item->stale || !item->flag)
+            art_item_delete(mh, item);
+        else
+        {
+            unused_items.append(item);
+            unused_bytes += item_size(item);
+            trim_cache(mh, (int64_t)aud_get_int("art_cache_size") << 20);
+        }
+    }
+}
+
+static AudArtItem * art_item_get(aud::mutex::holder & mh,
+                                 const String & filename, bool * queued)
 {
     if (queued)
         *queued = false;
@@ -124,16 +220,13 @@ static AudArtItem * art_item_get(aud::mutex::holder &, const String & filename,
 
     if (item && item->flag)
     {
-        item->refcount++;
+        art_item_ref(mh, item);
         return item;
     }
 
     if (!item)
     {
-        item = art_items.add(filename, AudArtItem());
-        item->filename = filename;
-        item->refcount = 1; /* temporary reference */
-
+        art_item_add(mh, filename, filename); /* temporary reference */
         scanner_request(
             new ScanRequest(filename, SCAN_IMAGE, request_callback));
     }
@@ -144,29 +237,193 @@ static AudArtItem * art_item_get(aud::mutex::holder &, const String & filename,
     return nullptr;
 }
 
-static void art_item_unref(aud::mutex::holder &, AudArtItem * item)
+static void clear_current(aud::mutex::holder & mh)
 {
-    if (!--item->refcount)
+    if (current_item)
     {
-        /* delete temporary file */
-        if (item->art_file && item->is_temp)
-        {
-            StringBuf local = uri_to_filename(item->art_file);
-            if (local)
-                g_unlink(local);
-        }
+        art_item_unref(mh, current_item);
+        current_item = nullptr;
+    }
+}
+
+/* smallest thumbnail size at least <size>, or 0 if too large */
+static int thumb_size(int size)
+{
+    if (size <= 0 || size > THUMB_MAX_SIZE)
+        return 0;
+
+    int thumb = THUMB_MIN_SIZE;
+    while (thumb < size)
+        thumb *= 2;
+
+    return thumb;
+}
+
+static String thumb_key(const char * filename, int size)
+{
+    return String(str_printf("thumb:%d:%s", size, filename));
+}
+
+/* Thumbnails of local files are also saved on disk, named after the MD5 sum
+ * of the URI (as in the freedesktop.org thumbnail specification).  They are
+ * only used if neither the song file nor the image file they were made from
+ * (for external album art) has been modified since. */
+static StringBuf thumb_path(const char * filename, int size, int64_t & mtime)
+{
+    StringBuf local = uri_to_filename(filename);
+    int64_t file_size;
+
+    if (!local || !local_file_stamp(local, mtime, file_size))
+        return StringBuf();
+
+    char * md5 = g_compute_checksum_for_string(G_CHECKSUM_MD5, filename, -1);
+    StringBuf name = str_printf("%s-%d", md5, size);
+    g_free(md5);
+
+    return filename_build(
+        {g_get_user_cache_dir(), PACKAGE, "thumbnails", name});
+}
+
+/* modification time of an external image file, or 0 for embedded art */
+static bool thumb_source_stamp(const char * art_file, int64_t & mtime)
+{
+    mtime = 0;
+    if (!art_file[0])
+        return true;
+
+    StringBuf local = uri_to_filename(art_file);
+    int64_t file_size;
+
+    return local && local_file_stamp(local, mtime, file_size);
+}
+
+static Index<char> thumb_load(const char * filename, int size)
+{
+    int64_t mtime, art_mtime;
+    StringBuf path = thumb_path(filename, size, mtime);
+    if (!path)
+        return Index<char>();
+
+    VFSFile file(filename_to_uri(path), "rm");
+    if (!file)
+        return Index<char>();
+
+    char header[THUMB_HEADER_SIZE];
+    int64_t saved_mtime, saved_art_mtime;
+    int32_t art_file_len;
+
+    if (file.fread(header, 1, sizeof header) != sizeof header ||
+        memcmp(header, THUMB_MAGIC, 8))
+        return Index<char>();
+
+    memcpy(&saved_mtime, header + 8, 8);
+    memcpy(&saved_art_mtime, header + 16, 8);
+    memcpy(&art_file_len, header + 24, 4);
+
+    if (saved_mtime != mtime || art_file_len < 0 ||
+        art_file_len > THUMB_MAX_URI)
+        return Index<char>();
+
+    StringBuf art_file(art_file_len);
+    if (file.fread(art_file, 1, art_file_len) != art_file_len ||
+        !thumb_source_stamp(art_file, art_mtime) ||
+        saved_art_mtime != art_mtime)
+        return Index<char>();
+
+    return file.read_all();
+}
+
+/* The thumbnail is written to a temporary file first, so that a thread or
+ * another instance loading it at the same time never sees a partial file. */
+static void thumb_save(const char * filename, const char * art_file, int size,
+                       const void * data, int64_t len)
+{
+    int64_t mtime, art_mtime;
+    StringBuf path = thumb_path(filename, size, mtime);
+    if (!path || !thumb_source_stamp(art_file, art_mtime))
+        return;
 
-        art_items.remove(item->filename);
+    int32_t art_file_len = strlen(art_file);
+    if (art_file_len > THUMB_MAX_URI)
+        return;
+
+    if (g_mkdir_with_parents(filename_get_parent(path), DIRMODE) < 0)
+        return;
+
+    StringBuf temp = str_concat({path, ".XXXXXX"});
+    int handle = g_mkstemp(temp);
+    if (handle < 0)
+        return;
+
+    close(handle);
+
+    char header[THUMB_HEADER_SIZE];
+    memcpy(header, THUMB_MAGIC, 8);
+    memcpy(header + 8, &mtime, 8);
+    memcpy(header + 16, &art_mtime, 8);
+    memcpy(header + 24, &art_file_len, 4);
+
+    bool success;
+
+    {
+        VFSFile file(filename_to_uri(temp), "w");
+        success = file &&
+                  file.fwrite(header, 1, sizeof header) == sizeof header &&
+                  file.fwrite(art_file, 1, art_file_len) == art_file_len &&
+                  file.fwrite(data, 1, len) == len && file.fflush() == 0;
+    }
+
+    if (!success || g_rename(temp, path) < 0)
+    {
+        AUDWARN("Error saving thumbnail for %s\n", filename);
+        g_unlink(temp);
     }
 }
 
-static void clear_current(aud::mutex::holder & mh)
+/* An item with no data records that there is no thumbnail in this size (for
+ * example because the original image is smaller), so that the disk is not
+ * checked again on every request.  Such items are never referenced. */
+static AudArtItem * thumb_ref(aud::mutex::holder & mh, AudArtItem * item)
 {
-    if (current_item)
+    if (!item->data.len())
+        return nullptr;
+
+    art_item_ref(mh, item);
+    return item;
+}
+
+static AudArtItem * thumb_get(aud::mutex::holder & mh, const char * filename,
+                              int size)
+{
+    String key = thumb_key(filename, size);
+    AudArtItem * item = art_items.lookup(key);
+
+    if (item)
+        return thumb_ref(mh, item);
+
+    if (!aud_get_bool("art_thumbnail_cache"))
+        return nullptr;
+
+    /* don't block other threads while reading */
+    mh.unlock();
+    Index<char> data = thumb_load(filename, size);
+    mh.lock();
+
+    /* someone else may have added it meanwhile */
+    if ((item = art_items.lookup(key)))
+        return thumb_ref(mh, item);
+
+    item = art_item_add(mh, key, String(filename));
+    item->data = std::move(data);
+    item->flag = FLAG_SENT;
+
+    if (!item->data.len())
     {
-        art_item_unref(mh, current_item);
-        current_item = nullptr;
+        art_item_unref(mh, item); /* straight into the cache */
+        return nullptr;
     }
+
+    return item;
 }
 
 void art_cache_current(const String & filename, Index<char> && data,
@@ -178,15 +435,11 @@ void art_cache_current(const String & filename, Index<char> && data,
     AudArtItem * item = art_items.lookup(filename);
 
     if (!item)
-    {
-        item = art_items.add(filename, AudArtItem());
-        item->filename = filename;
-        item->refcount = 1; /* temporary reference */
-    }
+        item = art_item_add(mh, filename, filename); /* temporary reference */
 
     finish_item(mh, item, std::move(data), std::move(art_file));
 
-    item->refcount++;
+    art_item_ref(mh, item);
     current_item = item;
 }
 
@@ -196,6 +449,31 @@ void art_clear_current()
     clear_current(mh);
 }
 
+void art_invalidate(const char * filename)
+{
+    auto mh = mutex.take();
+
+    auto invalidate = [&](const String & key) {
+        AudArtItem * item = art_items.lookup(key);
+        if (!item || !item->flag)
+            return;
+
+        if (item->refcount)
+            item->stale = true;
+        else
+        {
+            unused_items.remove(item);
+            unused_bytes -= item_size(item);
+            art_item_delete(mh, item);
+        }
+    };
+
+    invalidate(String(filename));
+
+    for (int size = THUMB_MIN_SIZE; size <= THUMB_MAX_SIZE; size *= 2)
+        invalidate(thumb_key(filename, size));
+}
+
 void art_cleanup()
 {
     auto queued = get_queued();
@@ -205,13 +483,37 @@ void art_cleanup()
     /* playback should already be stopped */
     assert(!current_item);
 
+    auto mh = mutex.take();
+    trim_cache(mh, 0);
+
     if (art_items.n_items())
         AUDWARN("Album art reference count not zero at exit!\n");
 }
 
 EXPORT AudArtPtr aud_art_request(const char * file, int format, bool * queued)
+{
+    return aud_art_request(file, format, queued, 0);
+}
+
+EXPORT AudArtPtr aud_art_request(const char * file, int format, bool * queued,
+                                 int size)
 {
     auto mh = mutex.take();
+
+    /* a thumbnail is returned as is, even if it turns out to be smaller than
+     * requested (because the original image is small) */
+    if ((size = thumb_size(size)) && format == AUD_ART_DATA)
+    {
+        AudArtItem * item = thumb_get(mh, file, size);
+        if (item)
+        {
+            if (queued)
+                *queued = false;
+
+            return AudArtPtr(item);
+        }
+    }
+
     AudArtItem * item = art_item_get(mh, String(file), queued);
 
     if (!item)
@@ -222,7 +524,7 @@ EXPORT AudArtPtr aud_art_request(const char * file, int format, bool * queued)
         /* load data from external image file */
         if (!item->data.len() && item->art_file)
         {
-            VFSFile file(item->art_file, "r");
+            VFSFile file(item->art_file, "rm");
             if (file)
                 item->data = file.read_all();
         }
@@ -258,6 +560,47 @@ EXPORT AudArtPtr aud_art_request(const char * file, int format, bool * queued)
     return AudArtPtr(item);
 }
 
+EXPORT int aud_art_thumbnail_size(int size) { return thumb_size(size); }
+
+EXPORT void aud_art_store_thumbnail(const char * file, int size,
+                                    const void * data, int64_t len)
+{
+    if (size != thumb_size(size) || len <= 0)
+        return;
+
+    auto mh = mutex.take();
+    String key = thumb_key(file, size);
+    AudArtItem * item = art_items.lookup(key);
+
+    /* the thumbnail is saved on disk only if it is known what it was made
+     * from (normally the caller still holds the full-size image) */
+    AudArtItem * source = art_items.lookup(String(file));
+    bool known_source = source && source->flag;
+    String art_file = (known_source && !source->is_temp) ? source->art_file
+                                                         : String();
+
+    if (!item)
+    {
+        item = art_item_add(mh, key, String(file));
+        item->data.insert((const char *)data, 0, len);
+        item->flag = FLAG_SENT;
+        art_item_unref(mh, item); /* straight into the cache */
+    }
+    else if (!item->data.len())
+    {
+        /* replace the "no thumbnail" marker (which is unreferenced) */
+        item->data.insert((const char *)data, 0, len);
+        unused_bytes += len;
+        trim_cache(mh, (int64_t)aud_get_int("art_cache_size") << 20);
+    }
+
+    mh.unlock();
+
+    if (known_source && aud_get_bool("art_thumbnail_cache"))
+        thumb_save(file, art_file ? (const char *)art_file : "", size, data,
+                   len);
+}
+
 EXPORT const Index<char> * aud_art_data(const AudArtItem * item)
 {
     return &item->data;
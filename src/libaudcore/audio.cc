@@ -20,9 +20,11 @@
 #include <fenv.h>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #define WANT_AUD_BSWAP
 #include "audio.h"
+#include "internal.h"
 #include "templates.h"
 
 #define SW_VOLUME_RANGE 40 /* decibels */
@@ -292,8 +294,8 @@ void to_int_loop(const float * in, void * out_, int samples)
     }
 }
 
-EXPORT void audio_from_int(const void * in, int format, float * out,
-                           int samples)
+static void from_int_scalar(const void * in, int format, float * out,
+                            int samples)
 {
     switch (format)
     {
@@ -358,11 +360,9 @@ EXPORT void audio_from_int(const void * in, int format, float * out,
     }
 }
 
-EXPORT void audio_to_int(const float * in, void * out, int format, int samples)
+static void to_int_scalar(const float * in, void * out, int format,
+                          int samples)
 {
-    int save = fegetround();
-    fesetround(FE_TONEAREST);
-
     switch (format)
     {
     case FMT_S8:
@@ -424,12 +424,10 @@ EXPORT void audio_to_int(const float * in, void * out, int format, int samples)
         to_int_loop<FMT_U24_3BE, packed24_t, int32_t>(in, out, samples);
         break;
     }
-
-    fesetround(save);
 }
 
-EXPORT void audio_amplify(float * data, int channels, int frames,
-                          const float * factors)
+static void amplify_scalar(float * data, int channels, int frames,
+                           const float * factors)
 {
     float * end = data + channels * frames;
     int channel;
@@ -444,17 +442,721 @@ EXPORT void audio_amplify(float * data, int channels, int frames,
     }
 }
 
+/* linear approximation of y = sin(x) */
+/* contributed by Anders Johansson */
+static void soft_clip_scalar(float * data, int samples)
+{
+    float * end = data + samples;
+
+    while (data < end)
+    {
+        float x = *data;
+        float y = fabsf(x);
+
+        if (y <= 0.4)
+            ; /* (0, 0.4) -> (0, 0.4) */
+        else if (y <= 0.7)
+            y = 0.8 * y + 0.08; /* (0.4, 0.7) -> (0.4, 0.64) */
+        else if (y <= 1.0)
+            y = 0.7 * y + 0.15; /* (0.7, 1) -> (0.64, 0.85) */
+        else if (y <= 1.3)
+            y = 0.4 * y + 0.45; /* (1, 1.3) -> (0.85, 0.97) */
+        else if (y <= 1.5)
+            y = 0.15 * y + 0.775; /* (1.3, 1.5) -> (0.97, 1) */
+        else
+            y = 1.0; /* (1.5, inf) -> 1 */
+
+        *data++ = (x > 0) ? y : -y;
+    }
+}
+
+/*
+ * Vectorized implementations.  These use GCC/Clang vector extensions rather
+ * than intrinsics and are always inlined, so that the same code is compiled
+ * for each instruction set by the target-specific wrapper functions further
+ * down.  The arithmetic is the same as in the scalar loops above, so the
+ * results are bit-identical.  Any samples left over at the end of a buffer
+ * are handled by the scalar code, as are the packed 24-bit formats (moving
+ * 3-byte words in and out of vector registers costs more than it saves).
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define AUDIO_X86
+#elif defined(__aarch64__)
+#define AUDIO_NEON
+#endif
+
+#define SIMD_INLINE inline __attribute__((always_inline))
+
+template<int N>
+struct Vec;
+
+template<>
+struct Vec<4>
+{
+    typedef float F __attribute__((vector_size(16)));
+    typedef double D __attribute__((vector_size(32)));
+    typedef int32_t I __attribute__((vector_size(16)));
+    typedef uint32_t U __attribute__((vector_size(16)));
+    typedef uint8_t U8 __attribute__((vector_size(4)));
+    typedef uint16_t U16 __attribute__((vector_size(8)));
+};
+
+template<>
+struct Vec<8>
+{
+    typedef float F __attribute__((vector_size(32)));
+    typedef double D __attribute__((vector_size(64)));
+    typedef int32_t I __attribute__((vector_size(32)));
+    typedef uint32_t U __attribute__((vector_size(32)));
+    typedef uint8_t U8 __attribute__((vector_size(8)));
+    typedef uint16_t U16 __attribute__((vector_size(16)));
+};
+
+/* byte order of a word differs from native */
+static constexpr bool needs_swap(int format)
+{
+#ifdef WORDS_BIGENDIAN
+    constexpr bool native_le = false;
+#else
+    constexpr bool native_le = true;
+#endif
+
+    return FMT_SIZEOF(format) > 1 && is_le(format) != native_le;
+}
+
+/* parameters of an integer format, for use by the vectorized loops */
+struct IntFormat
+{
+    int size;
+    bool swap;
+    uint32_t in_add, out_add; /* bias added before masking */
+    uint32_t mask;
+    uint32_t neg, pos;
+
+    IntFormat(int format)
+        : size(FMT_SIZEOF(format)), swap(needs_swap(format)),
+          in_add(is_signed(format) ? neg_range(format) : 0),
+          out_add(is_signed(format) ? 0 : neg_range(format)),
+          mask(2 * neg_range(format) - 1), neg(neg_range(format)),
+          pos(pos_range(format))
+    {
+    }
+};
+
+template<class U>
+static SIMD_INLINE void swap16(U & bits)
+{
+    bits = ((bits & 0xff) << 8) | ((bits >> 8) & 0xff);
+}
+
+template<class U>
+static SIMD_INLINE void swap32(U & bits)
+{
+    bits = (bits << 24) | ((bits & 0xff00) << 8) | ((bits >> 8) & 0xff00) |
+           (bits >> 24);
+}
+
+/* reads N words, zero-extended to 32 bits and in native byte order */
+template<int N, int size, bool swap>
+static SIMD_INLINE void read_bits(const void * in, typename Vec<N>::U & bits)
+{
+    typedef Vec<N> V;
+
+    if constexpr (size == 1)
+    {
+        typename V::U8 words;
+        memcpy(&words, in, sizeof words);
+        bits = __builtin_convertvector(words, typename V::U);
+    }
+    else if constexpr (size == 2)
+    {
+        typename V::U16 words;
+        memcpy(&words, in, sizeof words);
+        bits = __builtin_convertvector(words, typename V::U);
+        if (swap)
+            swap16(bits);
+    }
+    else
+    {
+        memcpy(&bits, in, sizeof bits);
+        if (swap)
+            swap32(bits);
+    }
+}
+
+/* writes the low bits of N words */
+template<int N, int size, bool swap>
+static SIMD_INLINE void write_bits(typename Vec<N>::U & bits, void * out)
+{
+    typedef Vec<N> V;
+
+    if constexpr (size == 1)
+    {
+        auto words = __builtin_convertvector(bits, typename V::U8);
+        memcpy(out, &words, sizeof words);
+    }
+    else if constexpr (size == 2)
+    {
+        if (swap)
+            swap16(bits);
+        auto words = __builtin_convertvector(bits, typename V::U16);
+        memcpy(out, &words, sizeof words);
+    }
+    else
+    {
+        if (swap)
+            swap32(bits);
+        memcpy(out, &bits, sizeof bits);
+    }
+}
+
+/* returns the number of samples converted; the gain is applied in the same
+ * pass (multiplying by 1 is exact) */
+template<int N, int size, bool swap>
+static SIMD_INLINE int from_int_vec(const IntFormat & f, const void * in,
+                                    float * out, int samples, float gain)
+{
+    typedef Vec<N> V;
+
+    int todo = samples - samples % N;
+    float scale = 1.0f / f.neg;
+
+    for (int i = 0; i < todo; i += N)
+    {
+        typename V::U bits;
+        read_bits<N, size, swap>((const char *)in + size * i, bits);
+
+        /* sign-extend or remove bias, see Convert::to_int() */
+        bits = ((bits + f.in_add) & f.mask) - f.neg;
+
+        auto value = __builtin_convertvector((typename V::I)bits,
+                                             typename V::F) *
+                     scale;
+        value *= gain;
+        memcpy(out + i, &value, sizeof value);
+    }
+
+    return todo;
+}
+
+/* converts and writes one vector (overwriting <value>) */
+template<int N, int size, bool swap>
+static SIMD_INLINE void to_int_one(const IntFormat & f,
+                                   typename Vec<N>::F & value, void * out)
+{
+    typedef Vec<N> V;
+
+    auto low = typename V::F() - (float)f.neg;
+    auto high = typename V::F() + (float)f.pos;
+
+    /* same comparisons as aud::clamp() */
+    value *= (float)f.neg;
+    value = (value > low) ? value : low;
+    value = (value < high) ? value : high;
+
+    /* round to nearest (even), like lrintf() in to_int_loop(); the
+     * difference from the truncated value is exact */
+    auto rounded = __builtin_convertvector(value, typename V::I);
+    auto diff = value - __builtin_convertvector(rounded, typename V::F);
+    auto odd = (rounded & 1) != 0;
+
+    rounded -= (diff > 0.5f) | ((diff == 0.5f) & odd);
+    rounded += (diff < -0.5f) | ((diff == -0.5f) & odd);
+
+    /* add bias and zero high bits, see Convert::to_word() */
+    auto bits = (((typename V::U)rounded) + f.out_add) & f.mask;
+    write_bits<N, size, swap>(bits, out);
+}
+
+/* returns the number of samples converted */
+template<int N, int size, bool swap>
+static SIMD_INLINE int to_int_vec(const IntFormat & f, const float * in,
+                                  void * out, int samples)
+{
+    typedef Vec<N> V;
+
+    int todo = samples - samples % N;
+
+    for (int i = 0; i < todo; i += N)
+    {
+        typename V::F value;
+        memcpy(&value, in + i, sizeof value);
+        to_int_one<N, size, swap>(f, value, (char *)out + size * i);
+    }
+
+    return todo;
+}
+
+template<int N>
+static SIMD_INLINE int from_int_simd(const void * in, int format, float * out,
+                                     int samples, float gain)
+{
+    IntFormat f(format);
+
+    switch (f.size)
+    {
+    case 1:
+        return from_int_vec<N, 1, false>(f, in, out, samples, gain);
+    case 2:
+        return f.swap ? from_int_vec<N, 2, true>(f, in, out, samples, gain)
+                      : from_int_vec<N, 2, false>(f, in, out, samples, gain);
+    case 4:
+        return f.swap ? from_int_vec<N, 4, true>(f, in, out, samples, gain)
+                      : from_int_vec<N, 4, false>(f, in, out, samples, gain);
+    default:
+        return 0; /* packed 24-bit */
+    }
+}
+
+template<int N>
+static SIMD_INLINE int to_int_simd(const float * in, void * out, int format,
+                                   int samples)
+{
+    IntFormat f(format);
+
+    switch (f.size)
+    {
+    case 1:
+        return to_int_vec<N, 1, false>(f, in, out, samples);
+    case 2:
+        return f.swap ? to_int_vec<N, 2, true>(f, in, out, samples)
+                      : to_int_vec<N, 2, false>(f, in, out, samples);
+    case 4:
+        return f.swap ? to_int_vec<N, 4, true>(f, in, out, samples)
+                      : to_int_vec<N, 4, false>(f, in, out, samples);
+    default:
+        return 0; /* packed 24-bit */
+    }
+}
+
+/* the factors repeat every <channels> vectors */
+template<int N>
+static SIMD_INLINE void make_pattern(int channels, const float * factors,
+                                     typename Vec<N>::F * pattern)
+{
+    for (int v = 0; v < channels; v++)
+    {
+        for (int i = 0; i < N; i++)
+            pattern[v][i] = factors[(v * N + i) % channels];
+    }
+}
+
+/* returns the number of frames processed */
+template<int N>
+static SIMD_INLINE int amplify_simd(float * data, int channels, int frames,
+                                    const float * factors)
+{
+    typedef Vec<N> V;
+
+    if (channels < 1 || channels > AUD_MAX_CHANNELS)
+        return 0;
+
+    typename V::F pattern[AUD_MAX_CHANNELS];
+    make_pattern<N>(channels, factors, pattern);
+
+    int todo = frames - frames % N;
+    float * end = data + channels * todo;
+
+    while (data < end)
+    {
+        for (int v = 0; v < channels; v++, data += N)
+        {
+            typename V::F value;
+            memcpy(&value, data, sizeof value);
+            value *= pattern[v];
+            memcpy(data, &value, sizeof value);
+        }
+    }
+
+    return todo;
+}
+
+template<int N>
+static SIMD_INLINE void soft_clip_one(typename Vec<N>::F & x)
+{
+    typedef Vec<N> V;
+
+    /* like fabsf(), including for -0 */
+    auto abs = (typename V::F)((typename V::U)x & 0x7fffffff);
+
+    /* same segments as soft_clip_scalar(), computed in double precision as
+     * there */
+    auto in = __builtin_convertvector(abs, typename V::D);
+    auto res = typename V::D() + 1.0;
+
+    res = (in <= 1.5) ? 0.15 * in + 0.775 : res;
+    res = (in <= 1.3) ? 0.4 * in + 0.45 : res;
+    res = (in <= 1.0) ? 0.7 * in + 0.15 : res;
+    res = (in <= 0.7) ? 0.8 * in + 0.08 : res;
+    res = (in <= 0.4) ? in : res;
+
+    auto y = __builtin_convertvector(res, typename V::F);
+    x = (x > 0) ? y : -y;
+}
+
+/* returns the number of samples processed */
+template<int N>
+static SIMD_INLINE int soft_clip_simd(float * data, int samples)
+{
+    typedef Vec<N> V;
+
+    int todo = samples - samples % N;
+
+    for (int i = 0; i < todo; i += N)
+    {
+        typename V::F x;
+        memcpy(&x, data + i, sizeof x);
+        soft_clip_one<N>(x);
+        memcpy(data + i, &x, sizeof x);
+    }
+
+    return todo;
+}
+
+/* Volume, soft clipping and conversion to the output format in a single pass,
+ * each vector going through all three while it is in a register.  For float
+ * output (size 0), the result is written back to <data>; otherwise <data> is
+ * left unchanged.  Returns the number of samples processed. */
+template<int N, int size, bool swap, bool amplify, bool clip>
+static SIMD_INLINE int convert_output_loop(const IntFormat & f, float * data,
+                                           void * out, int channels,
+                                           int samples,
+                                           const typename Vec<N>::F * pattern)
+{
+    typedef Vec<N> V;
+
+    int block = N * channels;
+    int todo = samples - samples % block;
+
+    for (int i = 0; i < todo; i += block)
+    {
+        for (int v = 0; v < channels; v++)
+        {
+            int pos = i + N * v;
+
+            typename V::F value;
+            memcpy(&value, data + pos, sizeof value);
+
+            if (amplify)
+                value *= pattern[v];
+            if (clip)
+                soft_clip_one<N>(value);
+
+            if constexpr (size == 0)
+                memcpy(data + pos, &value, sizeof value);
+            else
+                to_int_one<N, size, swap>(f, value, (char *)out + size * pos);
+        }
+    }
+
+    return todo;
+}
+
+/* <pattern> is null if there is no volume to apply */
+template<int N, int size, bool swap>
+static SIMD_INLINE int convert_output_vec(const IntFormat & f, float * data,
+                                          void * out, int channels,
+                                          int samples,
+                                          const typename Vec<N>::F * pattern,
+                                          bool soft_clip)
+{
+    if (pattern && soft_clip)
+        return convert_output_loop<N, size, swap, true, true>(
+            f, data, out, channels, samples, pattern);
+    if (pattern)
+        return convert_output_loop<N, size, swap, true, false>(
+            f, data, out, channels, samples, pattern);
+    if (soft_clip)
+        return convert_output_loop<N, size, swap, false, true>(
+            f, data, out, channels, samples, pattern);
+
+    return convert_output_loop<N, size, swap, false, false>(
+        f, data, out, channels, samples, pattern);
+}
+
+template<int N>
+static SIMD_INLINE int convert_output_simd(float * data, void * out, int format,
+                                           int channels, int samples,
+                                           const float * factors,
+                                           bool soft_clip)
+{
+    typedef Vec<N> V;
+
+    if (channels < 1 || channels > AUD_MAX_CHANNELS)
+        return 0;
+
+    typename V::F pattern[AUD_MAX_CHANNELS];
+    if (factors)
+        make_pattern<N>(channels, factors, pattern);
+
+    auto p = factors ? pattern : nullptr;
+
+    if (format == FMT_FLOAT)
+        return convert_output_vec<N, 0, false>(IntFormat(FMT_S32_NE), data, out,
+                                               channels, samples, p, soft_clip);
+
+    IntFormat f(format);
+
+    switch (f.size)
+    {
+    case 1:
+        return convert_output_vec<N, 1, false>(f, data, out, channels, samples,
+                                               p, soft_clip);
+    case 2:
+        return f.swap ? convert_output_vec<N, 2, true>(
+                            f, data, out, channels, samples, p, soft_clip)
+                      : convert_output_vec<N, 2, false>(
+                            f, data, out, channels, samples, p, soft_clip);
+    case 4:
+        return f.swap ? convert_output_vec<N, 4, true>(
+                            f, data, out, channels, samples, p, soft_clip)
+                      : convert_output_vec<N, 4, false>(
+                            f, data, out, channels, samples, p, soft_clip);
+    default:
+        return 0; /* packed 24-bit */
+    }
+}
+
+#ifdef AUDIO_X86
+__attribute__((target("sse2"))) static int
+from_int_sse2(const void * in, int format, float * out, int samples,
+              float gain)
+{
+    return from_int_simd<4>(in, format, out, samples, gain);
+}
+
+__attribute__((target("sse2"))) static int
+to_int_sse2(const float * in, void * out, int format, int samples)
+{
+    return to_int_simd<4>(in, out, format, samples);
+}
+
+__attribute__((target("sse2"))) static int
+amplify_sse2(float * data, int channels, int frames, const float * factors)
+{
+    return amplify_simd<4>(data, channels, frames, factors);
+}
+
+__attribute__((target("sse2"))) static int soft_clip_sse2(float * data,
+                                                          int samples)
+{
+    return soft_clip_simd<4>(data, samples);
+}
+
+__attribute__((target("sse2"))) static int
+convert_output_sse2(float * data, void * out, int format, int channels,
+                    int samples, const float * factors, bool soft_clip)
+{
+    return convert_output_simd<4>(data, out, format, channels, samples,
+                                    factors, soft_clip);
+}
+
+__attribute__((target("avx2"))) static int
+from_int_avx2(const void * in, int format, float * out, int samples,
+              float gain)
+{
+    return from_int_simd<8>(in, format, out, samples, gain);
+}
+
+__attribute__((target("avx2"))) static int
+to_int_avx2(const float * in, void * out, int format, int samples)
+{
+    return to_int_simd<8>(in, out, format, samples);
+}
+
+__attribute__((target("avx2"))) static int
+amplify_avx2(float * data, int channels, int frames, const float * factors)
+{
+    return amplify_simd<8>(data, channels, frames, factors);
+}
+
+__attribute__((target("avx2"))) static int soft_clip_avx2(float * data,
+                                                          int samples)
+{
+    return soft_clip_simd<8>(data, samples);
+}
+
+__attribute__((target("avx2"))) static int
+convert_output_avx2(float * data, void * out, int format, int channels,
+                    int samples, const float * factors, bool soft_clip)
+{
+    return convert_output_simd<8>(data, out, format, channels, samples,
+                                    factors, soft_clip);
+}
+#endif
+
+#ifdef AUDIO_NEON
+static int from_int_neon(const void * in, int format, float * out, int samples,
+                         float gain)
+{
+    return from_int_simd<4>(in, format, out, samples, gain);
+}
+
+static int to_int_neon(const float * in, void * out, int format, int samples)
+{
+    return to_int_simd<4>(in, out, format, samples);
+}
+
+static int amplify_neon(float * data, int channels, int frames,
+                        const float * factors)
+{
+    return amplify_simd<4>(data, channels, frames, factors);
+}
+
+static int soft_clip_neon(float * data, int samples)
+{
+    return soft_clip_simd<4>(data, samples);
+}
+
+static int convert_output_neon(float * data, void * out, int format,
+                               int channels, int samples, const float * factors,
+                               bool soft_clip)
+{
+    return convert_output_simd<4>(data, out, format, channels, samples,
+                                  factors, soft_clip);
+}
+#endif
+
+bool audio_impl_supported(AudioImpl impl)
+{
+    switch (impl)
+    {
+    case AudioImpl::Scalar:
+        return true;
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case AudioImpl::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+static AudioImpl best_impl()
+{
+#ifdef AUDIO_X86
+    __builtin_cpu_init(); /* may be called before constructors */
+#endif
+
+    for (AudioImpl impl : {AudioImpl::AVX2, AudioImpl::SSE2, AudioImpl::NEON})
+    {
+        if (audio_impl_supported(impl))
+            return impl;
+    }
+
+    return AudioImpl::Scalar;
+}
+
+static AudioImpl s_impl = best_impl();
+
+void audio_set_impl(AudioImpl impl) { s_impl = impl; }
+
+/* returns the number of samples converted (and amplified) */
+static int from_int_fast(const void * in, int format, float * out, int samples,
+                         float gain)
+{
+    switch (s_impl)
+    {
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        return from_int_sse2(in, format, out, samples, gain);
+    case AudioImpl::AVX2:
+        return from_int_avx2(in, format, out, samples, gain);
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        return from_int_neon(in, format, out, samples, gain);
+#endif
+    default:
+        return 0;
+    }
+}
+
+EXPORT void audio_from_int(const void * in, int format, float * out,
+                           int samples)
+{
+    int done = from_int_fast(in, format, out, samples, 1);
+
+    from_int_scalar((const char *)in + FMT_SIZEOF(format) * done, format,
+                    out + done, samples - done);
+}
+
+EXPORT void audio_to_int(const float * in, void * out, int format, int samples)
+{
+    int save = fegetround();
+    fesetround(FE_TONEAREST);
+
+    int done = 0;
+
+    switch (s_impl)
+    {
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        done = to_int_sse2(in, out, format, samples);
+        break;
+    case AudioImpl::AVX2:
+        done = to_int_avx2(in, out, format, samples);
+        break;
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        done = to_int_neon(in, out, format, samples);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    to_int_scalar(in + done, (char *)out + FMT_SIZEOF(format) * done, format,
+                  samples - done);
+
+    fesetround(save);
+}
+
 EXPORT void audio_amplify(float * data, int channels, int frames,
-                          StereoVolume volume)
+                          const float * factors)
+{
+    int done = 0;
+
+    switch (s_impl)
+    {
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        done = amplify_sse2(data, channels, frames, factors);
+        break;
+    case AudioImpl::AVX2:
+        done = amplify_avx2(data, channels, frames, factors);
+        break;
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        done = amplify_neon(data, channels, frames, factors);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    amplify_scalar(data + channels * done, channels, frames - done, factors);
+}
+
+/* returns false if the volume has no effect */
+static bool volume_factors(int channels, StereoVolume volume, float * factors)
 {
     if (channels < 1 || channels > AUD_MAX_CHANNELS)
-        return;
+        return false;
 
     if (volume.left == 100 && volume.right == 100)
-        return;
+        return false;
 
     float lfactor = 0, rfactor = 0;
-    float factors[AUD_MAX_CHANNELS];
 
     if (volume.left > 0)
         lfactor =
@@ -474,33 +1176,119 @@ EXPORT void audio_amplify(float * data, int channels, int frames,
             factors[c] = aud::max(lfactor, rfactor);
     }
 
-    audio_amplify(data, channels, frames, factors);
+    return true;
+}
+
+EXPORT void audio_amplify(float * data, int channels, int frames,
+                          StereoVolume volume)
+{
+    float factors[AUD_MAX_CHANNELS];
+    if (volume_factors(channels, volume, factors))
+        audio_amplify(data, channels, frames, factors);
 }
 
-/* linear approximation of y = sin(x) */
-/* contributed by Anders Johansson */
 EXPORT void audio_soft_clip(float * data, int samples)
 {
-    float * end = data + samples;
+    int done = 0;
 
-    while (data < end)
+    switch (s_impl)
     {
-        float x = *data;
-        float y = fabsf(x);
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        done = soft_clip_sse2(data, samples);
+        break;
+    case AudioImpl::AVX2:
+        done = soft_clip_avx2(data, samples);
+        break;
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        done = soft_clip_neon(data, samples);
+        break;
+#endif
+    default:
+        break;
+    }
 
-        if (y <= 0.4)
-            ; /* (0, 0.4) -> (0, 0.4) */
-        else if (y <= 0.7)
-            y = 0.8 * y + 0.08; /* (0.4, 0.7) -> (0.4, 0.64) */
-        else if (y <= 1.0)
-            y = 0.7 * y + 0.15; /* (0.7, 1) -> (0.64, 0.85) */
-        else if (y <= 1.3)
-            y = 0.4 * y + 0.45; /* (1, 1.3) -> (0.85, 0.97) */
-        else if (y <= 1.5)
-            y = 0.15 * y + 0.775; /* (1.3, 1.5) -> (0.97, 1) */
+    soft_clip_scalar(data + done, samples - done);
+}
+
+void audio_convert_input(const void * in, int format, float * out, int samples,
+                         float gain)
+{
+    if (format == FMT_FLOAT)
+    {
+        if (gain == 1)
+            memcpy(out, in, sizeof(float) * samples);
         else
-            y = 1.0; /* (1.5, inf) -> 1 */
+        {
+            auto from = (const float *)in;
+            for (int i = 0; i < samples; i++)
+                out[i] = from[i] * gain;
+        }
 
-        *data++ = (x > 0) ? y : -y;
+        return;
+    }
+
+    int done = from_int_fast(in, format, out, samples, gain);
+    int rest = samples - done;
+
+    /* leftover samples and packed 24-bit formats */
+    from_int_scalar((const char *)in + FMT_SIZEOF(format) * done, format,
+                    out + done, rest);
+    if (gain != 1)
+        amplify_scalar(out + done, 1, rest, &gain);
+}
+
+void audio_convert_output(float * data, void * out, int format, int channels,
+                          int samples, const StereoVolume * volume,
+                          bool soft_clip)
+{
+    float factors[AUD_MAX_CHANNELS];
+    bool amplify = volume && volume_factors(channels, *volume, factors);
+
+    if (format == FMT_FLOAT && !amplify && !soft_clip)
+        return;
+
+    int save = fegetround();
+    fesetround(FE_TONEAREST);
+
+    int done = 0;
+    const float * f = amplify ? factors : nullptr;
+
+    switch (s_impl)
+    {
+#ifdef AUDIO_X86
+    case AudioImpl::SSE2:
+        done = convert_output_sse2(data, out, format, channels, samples, f,
+                                   soft_clip);
+        break;
+    case AudioImpl::AVX2:
+        done = convert_output_avx2(data, out, format, channels, samples, f,
+                                   soft_clip);
+        break;
+#endif
+#ifdef AUDIO_NEON
+    case AudioImpl::NEON:
+        done = convert_output_neon(data, out, format, channels, samples, f,
+                                   soft_clip);
+        break;
+#endif
+    default:
+        break;
     }
+
+    /* leftover frames and packed 24-bit formats, one stage at a time */
+    float * rest = data + done;
+    int n_rest = samples - done;
+
+    if (amplify)
+        amplify_scalar(rest, channels, n_rest / channels, factors);
+    if (soft_clip)
+        soft_clip_scalar(rest, n_rest);
+    if (format != FMT_FLOAT)
+        to_int_scalar(rest, (char *)out + FMT_SIZEOF(format) * done, format,
+                      n_rest);
+
+    fesetround(save);
 }
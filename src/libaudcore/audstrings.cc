@@ -892,6 +892,44 @@ EXPORT int str_compare(const char * ap, const char * bp)
     return 0;
 }
 
+/* Appends to <key> a byte string such that comparing two keys with memcmp()
+ * (the shorter key first, if one is a prefix of the other) gives the same
+ * order as str_compare().  Each run of digits is encoded as '0' followed by
+ * its value in 4 bytes (sign bit flipped, big-endian), so that it compares
+ * the same way as any digit against other characters and by value against
+ * other runs of digits.  The value wraps around exactly like the int used in
+ * str_compare().  Keep the two functions in sync. */
+
+void str_append_collate_key(Index<char> & key, const char * str)
+{
+    for (const unsigned char * p = (const unsigned char *)str; *p;)
+    {
+        unsigned char c = *p++;
+
+        if (c > '9' || c < '0')
+        {
+            if (c <= 'Z' && c >= 'A')
+                c += 'a' - 'A';
+
+            key.append(c);
+        }
+        else
+        {
+            unsigned x = c - '0';
+            for (; (c = *p) <= '9' && c >= '0'; p++)
+                x = 10 * x + (c - '0');
+
+            x ^= 0x80000000u;
+
+            key.append('0');
+            key.append(x >> 24);
+            key.append(x >> 16);
+            key.append(x >> 8);
+            key.append(x);
+        }
+    }
+}
+
 /* Decodes percent-encoded strings, then compares them with str_compare. */
 
 EXPORT int str_compare_encoded(const char * ap, const char * bp)
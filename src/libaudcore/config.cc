@@ -35,6 +35,7 @@
 static const char * const core_defaults[] = {
     /* clang-format off */
     /* general */
+    "add_chunk_size", "256", /* 0 = add all files at once */
     "advance_on_delete", "FALSE",
     "always_resume_paused", "TRUE",
     "clear_playlist", "TRUE",
@@ -56,6 +57,10 @@ static const char * const core_defaults[] = {
     "equalizer_bands", "0,0,0,0,0,0,0,0,0,0",
     "equalizer_preamp", "0",
 
+    /* album art */
+    "art_cache_size", "32", /* MiB */
+    "art_thumbnail_cache", "TRUE",
+
     /* info popup / info window */
     "cover_name_exclude", "back",
     "cover_name_include", "album,cover,front,folder",
@@ -109,12 +114,19 @@ static const char * const core_defaults[] = {
     "folders_in_playlist", "FALSE",
     "generic_title_format", "${?artist:${artist} - }${?album:${album} - }${title}",
     "leading_zero", "FALSE",
+    "metadata_cache", "TRUE",
     "metadata_fallbacks", "TRUE",
     "metadata_on_play", "FALSE",
     "no_confirm_playlist_delete", "FALSE",
+    "scan_threads", "0", /* 0 = automatic */
     "show_hours", "TRUE",
     "show_numbers_in_pl", "FALSE",
     "slow_probe", "FALSE",
+
+    /* visualization */
+    "vis_fft_size", "512",
+    "vis_fps", "30", /* 0 = off */
+    "vis_fft_window", aud::numeric_string<(int) FFTWindow::Hamming>::str,
     /* clang-format on */
     nullptr};
 
@@ -0,0 +1,307 @@
+/*
+ * equalizer-filter.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "equalizer-filter.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "templates.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EQ_X86
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define EQ_NEON
+#endif
+
+/* Q value for band-pass filters 1.2247 = (3/2)^(1/2)
+ * Gives 4 dB suppression at Fc*2 and Fc/2 */
+#define Q 1.2247449f
+
+/* Center frequencies for band-pass filters (Hz) */
+/* These are not the historical WinAmp frequencies, because the IIR filters used
+ * here are designed for each frequency to be twice the previous.  Using WinAmp
+ * frequencies leads to too much gain in some bands and too little in others. */
+static const float CF[AUD_EQ_NBANDS] = {31.25f, 62.5f, 125,  250,  500,
+                                        1000,   2000,  4000, 8000, 16000};
+
+/* 2nd order band-pass filter design */
+static void bp2(float * a, float * b, float fc)
+{
+    float th = 2 * (float)M_PI * fc;
+    float C = (1 - tanf(th * Q / 2)) / (1 + tanf(th * Q / 2));
+
+    a[0] = (1 + C) * cosf(th);
+    a[1] = -C;
+    b[0] = (1 - C) / 2;
+    b[1] = -1.005f;
+}
+
+void EqFilter::set_format(int channels, int rate)
+{
+    m_channels = channels;
+
+    /* Calculate number of active filters: the center frequency must be less
+     * than rate/2Q to avoid singularities in the tangent used in bp2() */
+    m_bands = AUD_EQ_NBANDS;
+
+    while (m_bands > 0 && CF[m_bands - 1] > (float)rate / (2.005f * Q))
+        m_bands--;
+
+    /* Generate filter taps */
+    for (int k = 0; k < m_bands; k++)
+        bp2(m_a[k], m_b[k], CF[k] / (float)rate);
+
+    reset();
+}
+
+void EqFilter::reset()
+{
+    memset(m_w0, 0, sizeof m_w0);
+    memset(m_w1, 0, sizeof m_w1);
+}
+
+void EqFilter::set_gains(const float gains[AUD_EQ_NBANDS], bool ramp)
+{
+    for (int k = 0; k < AUD_EQ_NBANDS; k++)
+    {
+        float gv = powf(10, gains[k] / 20) - 1;
+
+        if (ramp)
+            m_gv_target[k] = gv;
+        else
+        {
+            for (int c = 0; c < EQ_MAX_LANES; c++)
+                m_gv[k][c] = gv;
+        }
+    }
+
+    m_ramp = ramp;
+}
+
+/* reference implementation, one channel at a time */
+template<bool Ramp>
+void EqFilter::process_scalar(float * data, int samples)
+{
+    for (int channel = 0; channel < m_channels; channel++)
+    {
+        float * end = data + samples;
+
+        for (float * f = data + channel; f < end; f += m_channels)
+        {
+            float yt = *f; /* Current input sample */
+
+            for (int k = 0; k < m_bands; k++)
+            {
+                float & w0 = m_w0[k][channel];
+                float & w1 = m_w1[k][channel];
+                float & gv = m_gv[k][channel];
+
+                /* Calculate output from AR part of current filter */
+                float w = yt * m_b[k][0] + w0 * m_a[k][0] + w1 * m_a[k][1];
+
+                /* Calculate output from MA part of current filter */
+                yt += (w + w1 * m_b[k][1]) * gv;
+
+                /* Update state */
+                w1 = w0;
+                w0 = w;
+
+                if (Ramp)
+                    gv += m_dgv[k][channel];
+            }
+
+            /* Calculate output */
+            *f = yt;
+        }
+    }
+}
+
+/* Vectorized implementation, processing N channels of each frame in parallel.
+ * The arithmetic is the same (and in the same order) as in process_scalar().
+ * The results are bit-identical in strict IEEE mode; with -ffast-math (as
+ * libaudcore is built), the compiler may reorder or contract either version
+ * differently, so they agree only to within rounding.  V is a GCC/Clang vector
+ * type; the function is always inlined so that it is compiled for the
+ * instruction set of the calling function. */
+template<class V, int N, bool Ramp>
+inline __attribute__((always_inline)) void
+EqFilter::process_lanes(float * data, int samples)
+{
+    int channels = m_channels;
+    int frames = channels ? samples / channels : 0;
+
+    for (int frame = 0; frame < frames; frame++, data += channels)
+    {
+        for (int lane = 0; lane < channels; lane += N)
+        {
+            int n = aud::min(N, channels - lane);
+
+            V yt = V();
+            memcpy(&yt, data + lane, sizeof(float) * n);
+
+            for (int k = 0; k < m_bands; k++)
+            {
+                V w0, w1, gv;
+                memcpy(&w0, m_w0[k] + lane, sizeof w0);
+                memcpy(&w1, m_w1[k] + lane, sizeof w1);
+                memcpy(&gv, m_gv[k] + lane, sizeof gv);
+
+                V w = yt * m_b[k][0] + w0 * m_a[k][0] + w1 * m_a[k][1];
+                yt += (w + w1 * m_b[k][1]) * gv;
+
+                memcpy(m_w1[k] + lane, &w0, sizeof w0);
+                memcpy(m_w0[k] + lane, &w, sizeof w);
+
+                if (Ramp)
+                {
+                    V dgv;
+                    memcpy(&dgv, m_dgv[k] + lane, sizeof dgv);
+                    gv += dgv;
+                    memcpy(m_gv[k] + lane, &gv, sizeof gv);
+                }
+            }
+
+            memcpy(data + lane, &yt, sizeof(float) * n);
+        }
+    }
+}
+
+typedef float v4sf __attribute__((vector_size(16)));
+typedef float v8sf __attribute__((vector_size(32)));
+
+#ifdef EQ_X86
+__attribute__((target("sse2"))) void
+EqFilter::process_sse(float * data, int samples, bool ramp)
+{
+    if (ramp)
+        process_lanes<v4sf, 4, true>(data, samples);
+    else
+        process_lanes<v4sf, 4, false>(data, samples);
+}
+
+__attribute__((target("avx"))) void
+EqFilter::process_avx(float * data, int samples, bool ramp)
+{
+    if (ramp)
+        process_lanes<v8sf, 8, true>(data, samples);
+    else
+        process_lanes<v8sf, 8, false>(data, samples);
+}
+#endif
+
+#ifdef EQ_NEON
+void EqFilter::process_neon(float * data, int samples, bool ramp)
+{
+    if (ramp)
+        process_lanes<v4sf, 4, true>(data, samples);
+    else
+        process_lanes<v4sf, 4, false>(data, samples);
+}
+#endif
+
+bool EqFilter::impl_supported(Impl impl) // static
+{
+    switch (impl)
+    {
+    case Scalar:
+        return true;
+#ifdef EQ_X86
+    case SSE:
+        return __builtin_cpu_supports("sse2");
+    case AVX:
+        return __builtin_cpu_supports("avx");
+#endif
+#ifdef EQ_NEON
+    case NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+EqFilter::Impl EqFilter::best_impl() // static
+{
+    for (Impl impl : {AVX, SSE, NEON})
+    {
+        if (impl_supported(impl))
+            return impl;
+    }
+
+    return Scalar;
+}
+
+void EqFilter::process(float * data, int samples)
+{
+    int frames = m_channels ? samples / m_channels : 0;
+    bool ramp = m_ramp && frames > 0;
+
+    /* spread the gain change evenly over the frames of this block */
+    if (ramp)
+    {
+        for (int k = 0; k < m_bands; k++)
+        {
+            for (int c = 0; c < EQ_MAX_LANES; c++)
+                m_dgv[k][c] = (m_gv_target[k] - m_gv[k][c]) / frames;
+        }
+    }
+
+    /* vectors that are mostly empty are slower than the scalar code */
+    Impl impl = m_impl;
+    if (!m_exact && m_channels <= 2)
+        impl = Scalar;
+    else if (!m_exact && impl == AVX && m_channels <= 4)
+        impl = SSE;
+
+    switch (impl)
+    {
+#ifdef EQ_X86
+    case SSE:
+        process_sse(data, samples, ramp);
+        break;
+    case AVX:
+        process_avx(data, samples, ramp);
+        break;
+#endif
+#ifdef EQ_NEON
+    case NEON:
+        process_neon(data, samples, ramp);
+        break;
+#endif
+    default:
+        if (ramp)
+            process_scalar<true>(data, samples);
+        else
+            process_scalar<false>(data, samples);
+        break;
+    }
+
+    /* land exactly on the target, without accumulated rounding error */
+    if (ramp)
+    {
+        for (int k = 0; k < AUD_EQ_NBANDS; k++)
+        {
+            for (int c = 0; c < EQ_MAX_LANES; c++)
+                m_gv[k][c] = m_gv_target[k];
+        }
+
+        m_ramp = false;
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * equalizer-filter.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_EQUALIZER_FILTER_H
+#define LIBAUDCORE_EQUALIZER_FILTER_H
+
+#include "audio.h"
+#include "equalizer.h"
+
+/* Filter state is stored with all channels of a band side by side ("structure
+ * of arrays"), so that the SIMD implementations can filter one sample of every
+ * channel in parallel.  The number of lanes is padded to a multiple of the
+ * widest vector. */
+#define EQ_MAX_LANES 16
+
+static_assert(EQ_MAX_LANES >= AUD_MAX_CHANNELS, "Update EQ_MAX_LANES");
+
+class EqFilter
+{
+public:
+    enum Impl
+    {
+        Scalar,
+        SSE, /* 4 lanes */
+        AVX, /* 8 lanes */
+        NEON /* 4 lanes */
+    };
+
+    /* fastest implementation supported by the running CPU */
+    static Impl best_impl();
+    static bool impl_supported(Impl impl);
+
+    /* Normally the scalar code is used for one or two channels, and SSE
+     * rather than AVX for up to four, since mostly empty vectors are slower.
+     * If <exact> is set, <impl> is used for any number of channels (for
+     * testing). */
+    void set_impl(Impl impl, bool exact = false)
+    {
+        m_impl = impl;
+        m_exact = exact;
+    }
+    Impl impl() const { return m_impl; }
+
+    /* resets the filter state */
+    void set_format(int channels, int rate);
+    void reset();
+
+    /* gains in dB (including preamp), applied to all channels; if ramp is
+     * set, the gains are interpolated linearly over the next block processed
+     * rather than changed abruptly */
+    void set_gains(const float gains[AUD_EQ_NBANDS], bool ramp = false);
+    bool ramping() const { return m_ramp; }
+
+    void process(float * data, int samples);
+
+private:
+    Impl m_impl = Scalar;
+    bool m_exact = false;
+    int m_channels = 0;
+    int m_bands = 0; /* number of used bands */
+
+    float m_a[AUD_EQ_NBANDS][2]; /* A weights */
+    float m_b[AUD_EQ_NBANDS][2]; /* B weights */
+
+    /* W data (previous two values) and gain factor, per band and lane */
+    alignas(32) float m_w0[AUD_EQ_NBANDS][EQ_MAX_LANES];
+    alignas(32) float m_w1[AUD_EQ_NBANDS][EQ_MAX_LANES];
+    alignas(32) float m_gv[AUD_EQ_NBANDS][EQ_MAX_LANES];
+
+    /* pending gain ramp: target gain factor and per-frame increment */
+    bool m_ramp = false;
+    float m_gv_target[AUD_EQ_NBANDS];
+    alignas(32) float m_dgv[AUD_EQ_NBANDS][EQ_MAX_LANES];
+
+    template<bool Ramp>
+    void process_scalar(float * data, int samples);
+    void process_sse(float * data, int samples, bool ramp);
+    void process_avx(float * data, int samples, bool ramp);
+    void process_neon(float * data, int samples, bool ramp);
+
+    template<class V, int N, bool Ramp>
+    void process_lanes(float * data, int samples);
+};
+
+#endif // LIBAUDCORE_EQUALIZER_FILTER_H
@@ -209,11 +209,20 @@ EXPORT bool aud_load_preset_file(EqualizerPreset & preset, VFSFile & file)
 
     GKeyFile * rcfile = g_key_file_new();
 
-    Index<char> data = file.read_all();
+    /* parse a mapped file in place rather than copying it */
+    int64_t size = 0;
+    const char * view = (file.ftell() == 0) ? file.view(size) : nullptr;
 
-    if (!data.len() ||
-        !g_key_file_load_from_data(rcfile, data.begin(), data.len(),
-                                   G_KEY_FILE_NONE, nullptr))
+    Index<char> data;
+    if (!view)
+    {
+        data = file.read_all();
+        view = data.begin();
+        size = data.len();
+    }
+
+    if (!size || !g_key_file_load_from_data(rcfile, view, size,
+                                            G_KEY_FILE_NONE, nullptr))
     {
         g_key_file_free(rcfile);
         return false;
@@ -22,136 +22,123 @@
 #include "internal.h"
 
 #include <assert.h>
-#include <math.h>
 #include <string.h>
 
-#include "audio.h"
+#include <atomic>
+
 #include "audstrings.h"
+#include "equalizer-filter.h"
 #include "hook.h"
 #include "runtime.h"
 #include "threads.h"
 
-/* Q value for band-pass filters 1.2247 = (3/2)^(1/2)
- * Gives 4 dB suppression at Fc*2 and Fc/2 */
-#define Q 1.2247449f
+/*
+ * The output thread must never block on a settings change from the UI (or
+ * from D-Bus, etc.), so the EQ settings are passed to it through a lock-free
+ * triple buffer.  The writer fills in its private slot and swaps it with the
+ * shared slot, flagging the shared slot as new.  The output thread, on seeing
+ * the flag, swaps its own slot with the shared one.  Each side therefore
+ * always owns a slot that the other side cannot touch.  The mutex serializes
+ * writers only.
+ *
+ * The filter itself is owned by the output thread (eq_set_format() and
+ * eq_filter() are serialized by the output code) and is not locked at all.
+ */
 
-/* Center frequencies for band-pass filters (Hz) */
-/* These are not the historical WinAmp frequencies, because the IIR filters used
- * here are designed for each frequency to be twice the previous.  Using WinAmp
- * frequencies leads to too much gain in some bands and too little in others. */
-static const float CF[AUD_EQ_NBANDS] = {31.25f, 62.5f, 125,  250,  500,
-                                        1000,   2000,  4000, 8000, 16000};
+struct EqParams
+{
+    bool active;
+    float gains[AUD_EQ_NBANDS]; // in dB, including preamp
+};
+
+#define SLOT_MASK 3
+#define SLOT_NEW 4
 
 static aud::mutex mutex;
-static bool active;
-static int channels, rate;
-static float a[AUD_EQ_NBANDS][2]; /* A weights */
-static float b[AUD_EQ_NBANDS][2]; /* B weights */
-static float wqv[AUD_MAX_CHANNELS][AUD_EQ_NBANDS]
-                [2]; /* Circular buffer for W data */
-static float gv[AUD_MAX_CHANNELS]
-               [AUD_EQ_NBANDS]; /* Gain factor for each channel and band */
-static int K;                   /* Number of used EQ bands */
-
-/* 2nd order band-pass filter design */
-static void bp2(float * a, float * b, float fc)
-{
-    float th = 2 * (float)M_PI * fc;
-    float C = (1 - tanf(th * Q / 2)) / (1 + tanf(th * Q / 2));
+static EqParams slots[3];
+static int write_slot = 0;              // owned by writers
+static std::atomic<int> shared_slot(1); // slot index | SLOT_NEW
+static int read_slot = 2;               // owned by output thread
 
-    a[0] = (1 + C) * cosf(th);
-    a[1] = -C;
-    b[0] = (1 - C) / 2;
-    b[1] = -1.005f;
-}
+/* owned by output thread */
+static EqFilter filter;
+static bool active;  // latest setting
+static bool running; // filter is running (possibly fading out)
 
 void eq_set_format(int new_channels, int new_rate)
 {
-    auto mh = mutex.take();
-
-    channels = new_channels;
-    rate = new_rate;
-
-    /* Calculate number of active filters: the center frequency must be less
-     * than rate/2Q to avoid singularities in the tangent used in bp2() */
-    K = AUD_EQ_NBANDS;
-
-    while (K > 0 && CF[K - 1] > (float)rate / (2.005f * Q))
-        K--;
-
-    /* Generate filter taps */
-    for (int k = 0; k < K; k++)
-        bp2(a[k], b[k], CF[k] / (float)rate);
-
-    /* Reset state */
-    memset(wqv[0][0], 0, sizeof wqv);
+    filter.set_format(new_channels, new_rate);
 }
 
 static void eq_set_bands_real(aud::mutex::holder &, double preamp,
                               double * values)
 {
-    float adj[AUD_EQ_NBANDS];
+    EqParams & params = slots[write_slot];
 
     for (int i = 0; i < AUD_EQ_NBANDS; i++)
-        adj[i] = preamp + values[i];
+        params.gains[i] = preamp + values[i];
+}
+
+static void apply_params(const EqParams & params)
+{
+    static const float flat[AUD_EQ_NBANDS] = {};
 
-    for (int c = 0; c < AUD_MAX_CHANNELS; c++)
+    if (params.active)
     {
-        for (int i = 0; i < AUD_EQ_NBANDS; i++)
-            gv[c][i] = powf(10, adj[i] / 20) - 1;
+        /* fade in from flat response */
+        if (!running)
+        {
+            filter.reset();
+            filter.set_gains(flat);
+            running = true;
+        }
+
+        filter.set_gains(params.gains, true);
     }
+    else if (running)
+        filter.set_gains(flat, true); /* fade out */
+
+    active = params.active;
 }
 
 void eq_filter(float * data, int samples)
 {
-    auto mh = mutex.take();
-
-    if (!active)
-        return;
-
-    for (int channel = 0; channel < channels; channel++)
+    if (shared_slot.load(std::memory_order_relaxed) & SLOT_NEW)
     {
-        float * g = gv[channel]; /* Gain factor */
-        float * end = data + samples;
-
-        for (float * f = data + channel; f < end; f += channels)
-        {
-            float yt = *f; /* Current input sample */
-
-            for (int k = 0; k < K; k++)
-            {
-                /* Pointer to circular buffer wq */
-                float * wq = wqv[channel][k];
-                /* Calculate output from AR part of current filter */
-                float w = yt * b[k][0] + wq[0] * a[k][0] + wq[1] * a[k][1];
+        read_slot = shared_slot.exchange(read_slot, std::memory_order_acq_rel) &
+                    SLOT_MASK;
+        apply_params(slots[read_slot]);
+    }
 
-                /* Calculate output from MA part of current filter */
-                yt += (w + wq[1] * b[k][1]) * g[k];
+    if (!running)
+        return;
 
-                /* Update circular buffer */
-                wq[1] = wq[0];
-                wq[0] = w;
-            }
+    filter.process(data, samples);
 
-            /* Calculate output */
-            *f = yt;
-        }
-    }
+    if (!active && !filter.ramping())
+        running = false;
 }
 
 static void eq_update(void *, void *)
 {
     auto mh = mutex.take();
 
-    active = aud_get_bool("equalizer_active");
+    slots[write_slot].active = aud_get_bool("equalizer_active");
 
     double values[AUD_EQ_NBANDS];
     aud_eq_get_bands(values);
     eq_set_bands_real(mh, aud_get_double("equalizer_preamp"), values);
+
+    /* publish */
+    write_slot = shared_slot.exchange(write_slot | SLOT_NEW,
+                                      std::memory_order_acq_rel) &
+                 SLOT_MASK;
 }
 
 void eq_init()
 {
+    filter.set_impl(EqFilter::best_impl());
+
     eq_update(nullptr, nullptr);
     hook_associate("set equalizer_active", eq_update, nullptr);
     hook_associate("set equalizer_preamp", eq_update, nullptr);
@@ -19,8 +19,6 @@
 
 #include "hook.h"
 
-#include <string.h>
-
 #include "internal.h"
 #include "list.h"
 #include "mainloop.h"
@@ -29,12 +27,12 @@
 
 struct Event : public ListNode
 {
-    String name;
+    HookId hook;
     void * data;
     void (*destroy)(void *);
 
-    Event(const char * name, void * data, EventDestroyFunc destroy)
-        : name(name), data(data), destroy(destroy)
+    Event(HookId hook, void * data, EventDestroyFunc destroy)
+        : hook(hook), data(data), destroy(destroy)
     {
     }
 
@@ -61,25 +59,30 @@ static void events_execute()
 
         mh.unlock();
 
-        hook_call(event->name, event->data);
+        hook_call(event->hook, event->data);
         delete event;
 
         mh.lock();
     }
 }
 
-EXPORT void event_queue(const char * name, void * data,
-                        EventDestroyFunc destroy)
+EXPORT void event_queue(HookId hook, void * data, EventDestroyFunc destroy)
 {
     auto mh = mutex.take();
 
     if (!paused && !events.head())
         queued_events.queue(events_execute);
 
-    events.append(new Event(name, data, destroy));
+    events.append(new Event(hook, data, destroy));
 }
 
-EXPORT void event_queue_cancel(const char * name, void * data)
+EXPORT void event_queue(const char * name, void * data,
+                        EventDestroyFunc destroy)
+{
+    event_queue(hook_find(name), data, destroy);
+}
+
+EXPORT void event_queue_cancel(HookId hook, void * data)
 {
     auto mh = mutex.take();
 
@@ -88,7 +91,7 @@ EXPORT void event_queue_cancel(const char * name, void * data)
     {
         Event * next = events.next(event);
 
-        if (!strcmp(event->name, name) && (!data || event->data == data))
+        if (event->hook == hook && (!data || event->data == data))
         {
             events.remove(event);
             delete event;
@@ -98,6 +101,14 @@ EXPORT void event_queue_cancel(const char * name, void * data)
     }
 }
 
+EXPORT void event_queue_cancel(const char * name, void * data)
+{
+    /* no events can be queued for a hook that has never been used */
+    HookId hook = hook_lookup(name);
+    if (hook)
+        event_queue_cancel(hook, data);
+}
+
 // this is only for use by the playlist, to ensure that queued playlist
 // updates are processed before generic events
 void event_queue_pause()
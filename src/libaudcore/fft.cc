@@ -19,28 +19,65 @@
 
 #include "internal.h"
 
-#include <complex>
 #include <math.h>
+#include <string.h>
+
+#include "index.h"
 
 #define TWO_PI 6.2831853f
 
-#define N 512  /* size of the DFT */
-#define LOGN 9 /* log N (base 2) */
+/* number of supported sizes: FFT_MIN_SIZE, 2 * FFT_MIN_SIZE, ... FFT_MAX_SIZE */
+#define N_SIZES 4
+
+static_assert(FFT_MIN_SIZE << (N_SIZES - 1) == FFT_MAX_SIZE, "Update N_SIZES");
+
+/*
+ * A real-input DFT of size N is computed as a complex DFT of size M = N/2 (the
+ * even samples forming the real part of the input, and the odd samples the
+ * imaginary part), followed by a split step which recovers the spectrum of the
+ * real signal.  The complex DFT works on separate arrays of real and imaginary
+ * parts, so that four butterflies at a time can be computed with vector
+ * instructions.  As in equalizer-filter.cc, these are GCC/Clang vector types,
+ * compiled for whatever the target supports (SSE2 and NEON are baseline on
+ * x86-64 and ARM64, respectively).
+ */
+
+typedef float v4sf __attribute__((vector_size(16)));
+
+struct FFTTables
+{
+    int size = 0;
+    FFTWindow window = FFTWindow::Hamming;
+
+    Index<float> win;    /* window, scaled to an average of 1 (N) */
+    Index<int> reversed; /* bit-reversal table (M) */
 
-typedef std::complex<float> Complex;
+    /* twiddle factors for each step of the complex DFT: for a butterfly span
+     * of h, entries h-1 through 2h-2 hold exp(-i*pi*b/h) for b=0..h-1 (M-1) */
+    Index<float> tw_re, tw_im;
 
-static float hamming[N];     /* hamming window, scaled to sum to 1 */
-static int reversed[N];      /* bit-reversal table */
-static Complex roots[N / 2]; /* N-th roots of unity */
-static char generated = 0;   /* set if tables have been generated */
+    /* twiddle factors for the split step: exp(-2i*pi*k/N) for k=0..M (M+1) */
+    Index<float> split_re, split_im;
+};
 
-/* Reverse the order of the lowest LOGN bits in an integer. */
+static FFTTables tables[N_SIZES];
 
-static int bit_reverse(int x)
+static int size_index(int size)
+{
+    int i = 0;
+    while ((FFT_MIN_SIZE << i) < size)
+        i++;
+
+    return i;
+}
+
+/* Reverse the order of the lowest <bits> bits in an integer. */
+
+static int bit_reverse(int x, int bits)
 {
     int y = 0;
 
-    for (int n = LOGN; n--;)
+    for (int n = bits; n--;)
     {
         y = (y << 1) | (x & 1);
         x >>= 1;
@@ -49,75 +86,202 @@ static int bit_reverse(int x)
     return y;
 }
 
+static float window_value(FFTWindow window, int n, int size)
+{
+    float x = n * (TWO_PI / size);
+
+    switch (window)
+    {
+    case FFTWindow::Hann:
+        return 1 - cosf(x);
+    case FFTWindow::BlackmanHarris:
+        return 0.35875f - 0.48829f * cosf(x) + 0.14128f * cosf(2 * x) -
+               0.01168f * cosf(3 * x);
+    case FFTWindow::Rectangular:
+        return 1;
+    default:
+        /* not a true Hamming window, but kept for compatibility */
+        return 1 - 0.85f * cosf(x);
+    }
+}
+
+static void generate_window(FFTTables & t, FFTWindow window)
+{
+    float sum = 0;
+
+    for (int n = 0; n < t.size; n++)
+    {
+        t.win[n] = window_value(window, n, t.size);
+        sum += t.win[n];
+    }
+
+    /* the legacy window already averages to 1 (and is not rescaled, so that
+     * its output does not change at all) */
+    if (window != FFTWindow::Hamming)
+    {
+        for (int n = 0; n < t.size; n++)
+            t.win[n] *= t.size / sum;
+    }
+
+    t.window = window;
+}
+
 /* Generate lookup tables. */
 
-static void generate_tables()
+static const FFTTables & get_tables(int size, FFTWindow window)
 {
-    if (generated)
-        return;
+    FFTTables & t = tables[size_index(size)];
+
+    if (t.size == size)
+    {
+        if (t.window != window)
+            generate_window(t, window);
+
+        return t;
+    }
 
-    for (int n = 0; n < N; n++)
-        hamming[n] = 1 - 0.85f * cosf(n * (TWO_PI / N));
-    for (int n = 0; n < N; n++)
-        reversed[n] = bit_reverse(n);
-    for (int n = 0; n < N / 2; n++)
-        roots[n] = exp(Complex(0, n * (TWO_PI / N)));
+    int m = size / 2;
+    int bits = 0;
+    while ((1 << bits) < m)
+        bits++;
 
-    generated = 1;
+    t.size = size;
+    t.win.resize(size);
+    t.reversed.resize(m);
+    t.tw_re.resize(m);
+    t.tw_im.resize(m);
+    t.split_re.resize(m + 1);
+    t.split_im.resize(m + 1);
+
+    generate_window(t, window);
+
+    for (int n = 0; n < m; n++)
+        t.reversed[n] = bit_reverse(n, bits);
+
+    for (int half = 1; half < m; half <<= 1)
+    {
+        for (int b = 0; b < half; b++)
+        {
+            t.tw_re[half - 1 + b] = cosf(b * (TWO_PI / 2) / half);
+            t.tw_im[half - 1 + b] = -sinf(b * (TWO_PI / 2) / half);
+        }
+    }
+
+    for (int k = 0; k <= m; k++)
+    {
+        t.split_re[k] = cosf(k * (TWO_PI / size));
+        t.split_im[k] = -sinf(k * (TWO_PI / size));
+    }
+
+    return t;
 }
 
 /* Perform the DFT using the Cooley-Tukey algorithm.  At each step s, where
- * s=1..log N (base 2), there are N/(2^s) groups of intertwined butterfly
+ * s=1..log M (base 2), there are M/(2^s) groups of intertwined butterfly
  * operations.  Each group contains (2^s)/2 butterflies, and each butterfly has
  * a span of (2^s)/2.  The twiddle factors are nth roots of unity where n = 2^s.
  */
 
-static void do_fft(Complex a[N])
+static void do_fft(const FFTTables & t, float * re, float * im, int m)
 {
-    int half = 1;    /* (2^s)/2 */
-    int inv = N / 2; /* N/(2^s) */
-
-    /* loop through steps */
-    while (inv)
+    /* first steps: fewer than 4 butterflies per group */
+    for (int half = 1; half < aud::min(m, 4); half <<= 1)
     {
-        /* loop through groups */
-        for (int g = 0; g < N; g += half << 1)
+        const float * wr = &t.tw_re[half - 1];
+        const float * wi = &t.tw_im[half - 1];
+
+        for (int g = 0; g < m; g += half << 1)
         {
-            /* loop through butterflies */
-            for (int b = 0, r = 0; b < half; b++, r += inv)
+            for (int b = 0; b < half; b++)
             {
-                Complex even = a[g + b];
-                Complex odd = roots[r] * a[g + half + b];
-                a[g + b] = even + odd;
-                a[g + half + b] = even - odd;
+                int e = g + b, o = g + half + b;
+
+                float tr = re[o] * wr[b] - im[o] * wi[b];
+                float ti = re[o] * wi[b] + im[o] * wr[b];
+
+                re[o] = re[e] - tr;
+                im[o] = im[e] - ti;
+                re[e] += tr;
+                im[e] += ti;
             }
         }
+    }
 
-        half <<= 1;
-        inv >>= 1;
+    /* remaining steps: four butterflies at a time */
+    for (int half = 4; half < m; half <<= 1)
+    {
+        const float * wr = &t.tw_re[half - 1];
+        const float * wi = &t.tw_im[half - 1];
+
+        for (int g = 0; g < m; g += half << 1)
+        {
+            for (int b = 0; b < half; b += 4)
+            {
+                int e = g + b, o = g + half + b;
+                v4sf er, ei, or_, oi, vwr, vwi;
+
+                memcpy(&er, re + e, sizeof er);
+                memcpy(&ei, im + e, sizeof ei);
+                memcpy(&or_, re + o, sizeof or_);
+                memcpy(&oi, im + o, sizeof oi);
+                memcpy(&vwr, wr + b, sizeof vwr);
+                memcpy(&vwi, wi + b, sizeof vwi);
+
+                v4sf tr = or_ * vwr - oi * vwi;
+                v4sf ti = or_ * vwi + oi * vwr;
+
+                v4sf sum_r = er + tr, sum_i = ei + ti;
+                v4sf diff_r = er - tr, diff_i = ei - ti;
+
+                memcpy(re + e, &sum_r, sizeof sum_r);
+                memcpy(im + e, &sum_i, sizeof sum_i);
+                memcpy(re + o, &diff_r, sizeof diff_r);
+                memcpy(im + o, &diff_i, sizeof diff_i);
+            }
+        }
     }
 }
 
-/* Input is N=512 PCM samples.
- * Output is intensity of frequencies from 1 to N/2=256. */
+/* Input is <size> PCM samples.
+ * Output is intensity of frequencies from 1 to size/2. */
 
-void calc_freq(const float data[N], float freq[N / 2])
+void calc_freq(const float * data, float * freq, int size, FFTWindow window)
 {
-    generate_tables();
+    const FFTTables & t = get_tables(size, window);
+    int m = size / 2;
+
+    alignas(16) float re[FFT_MAX_SIZE / 2];
+    alignas(16) float im[FFT_MAX_SIZE / 2];
 
-    /* input is filtered by a Hamming window */
+    /* input is filtered by the window */
+    /* even/odd samples are packed as real/imaginary parts */
     /* input values are in bit-reversed order */
-    Complex a[N];
-    for (int n = 0; n < N; n++)
-        a[reversed[n]] = data[n] * hamming[n];
+    for (int n = 0; n < m; n++)
+    {
+        re[t.reversed[n]] = data[2 * n] * t.win[2 * n];
+        im[t.reversed[n]] = data[2 * n + 1] * t.win[2 * n + 1];
+    }
 
-    do_fft(a);
+    do_fft(t, re, im, m);
 
-    /* output values are divided by N */
-    /* frequencies from 1 to N/2-1 are doubled */
-    for (int n = 0; n < N / 2 - 1; n++)
-        freq[n] = 2 * abs(a[1 + n]) / N;
+    /* separate the spectra of the even and odd samples and combine them */
+    for (int k = 1; k <= m; k++)
+    {
+        int k1 = (k < m) ? k : 0;
+        int k2 = m - k;
+
+        float er = (re[k1] + re[k2]) / 2;
+        float ei = (im[k1] - im[k2]) / 2;
+        float or_ = (im[k1] + im[k2]) / 2;
+        float oi = (re[k2] - re[k1]) / 2;
 
-    /* frequency N/2 is not doubled */
-    freq[N / 2 - 1] = abs(a[N / 2]) / N;
+        float xr = er + t.split_re[k] * or_ - t.split_im[k] * oi;
+        float xi = ei + t.split_re[k] * oi + t.split_im[k] * or_;
+
+        /* output values are divided by N */
+        /* frequencies from 1 to N/2-1 are doubled */
+        /* frequency N/2 is not doubled */
+        float scale = (k < m) ? 2.0f / size : 1.0f / size;
+        freq[k - 1] = sqrtf(xr * xr + xi * xi) * scale;
+    }
 }
@@ -19,6 +19,8 @@
 
 #include "hook.h"
 
+#include <atomic>
+
 #include "index.h"
 #include "internal.h"
 #include "multihash.h"
@@ -32,99 +34,191 @@ struct HookItem
     void * user;
 };
 
+/* The list of functions associated with a hook is never modified once it has
+ * been published.  Instead, a new list is built each time a function is added
+ * or removed, so that hook_call() only has to take a reference to the current
+ * list and can then run through it without holding any lock. */
 struct HookList
 {
     Index<HookItem> items;
-    int use_count;
+    std::atomic<int> refs{1};
+
+    void unref()
+    {
+        if (!--refs)
+            delete this;
+    }
+};
+
+struct HookData
+{
+    aud::spinlock lock; /* held while taking a reference to or replacing list */
+    std::atomic<HookList *> list{nullptr};
+
+    HookList * get_list()
+    {
+        auto lh = lock.take();
+        HookList * cur_list = list;
+        if (cur_list)
+            cur_list->refs++;
+        return cur_list;
+    }
+
+    void set_list(HookList * new_list)
+    {
+        lock.lock();
+        HookList * old = list;
+        list = new_list;
+        lock.unlock();
 
-    void compact()
+        if (old)
+            old->unref();
+    }
+
+    /* checks that <item>, from the list <from>, has not been removed since */
+    bool still_associated(HookList * from, const HookItem & item)
     {
-        auto is_empty = [](const HookItem & item) { return !item.func; };
+        if (list.load(std::memory_order_relaxed) == from)
+            return true;
+
+        auto lh = lock.take();
+        HookList * cur_list = list;
+        if (!cur_list)
+            return false;
+
+        for (const HookItem & cur : cur_list->items)
+        {
+            if (cur.func == item.func && cur.user == item.user)
+                return true;
+        }
 
-        items.remove_if(is_empty);
+        return false;
     }
 };
 
+/* guards the hash table, and serializes changes to the lists */
 static aud::mutex mutex;
-static SimpleHash<String, HookList> hooks;
+
+/* HookData is never freed before hook_cleanup(), so that a HookId remains valid
+ * even after all the functions have been removed from the hook */
+static SimpleHash<String, HookData *> hooks;
+
+static HookData * lookup(const char * name, bool add)
+{
+    String key(name);
+    HookData ** hook = hooks.lookup(key);
+
+    if (hook)
+        return *hook;
+    if (!add)
+        return nullptr;
+
+    return *hooks.add(key, new HookData);
+}
+
+EXPORT HookId hook_find(const char * name)
+{
+    auto mh = mutex.take();
+    return lookup(name, true);
+}
+
+HookId hook_lookup(const char * name)
+{
+    auto mh = mutex.take();
+    return lookup(name, false);
+}
 
 EXPORT void hook_associate(const char * name, HookFunction func, void * user)
 {
     auto mh = mutex.take();
 
-    String key(name);
-    HookList * list = hooks.lookup(key);
-    if (!list)
-        list = hooks.add(key, HookList());
+    HookData * hook = lookup(name, true);
+    HookList * old = hook->list;
+    HookList * list = new HookList;
+
+    if (old)
+        list->items.insert(old->items.begin(), 0, old->items.len());
 
     list->items.append(func, user);
+    hook->set_list(list);
 }
 
 EXPORT void hook_dissociate(const char * name, HookFunction func, void * user)
 {
     auto mh = mutex.take();
 
-    String key(name);
-    HookList * list = hooks.lookup(key);
-    if (!list)
+    HookData * hook = lookup(name, false);
+    HookList * old = hook ? hook->list.load() : nullptr;
+    if (!old)
         return;
 
-    for (HookItem & item : list->items)
+    HookList * list = new HookList;
+
+    for (const HookItem & item : old->items)
+    {
+        if (!(item.func == func && (!user || item.user == user)))
+            list->items.append(item);
+    }
+
+    if (!list->items.len())
     {
-        if (item.func == func && (!user || item.user == user))
-            item.func = nullptr;
+        delete list;
+        list = nullptr;
     }
 
-    if (!list->use_count)
+    hook->set_list(list);
+}
+
+static void call_list(HookData * hook, HookList * list, void * data)
+{
+    /* note: functions added during the hook call are not called until the
+     * next hook call, but functions removed are skipped immediately */
+    for (const HookItem & item : list->items)
     {
-        list->compact();
-        if (!list->items.len())
-            hooks.remove(key);
+        if (hook->still_associated(list, item))
+            item.func(data, item.user);
     }
+
+    list->unref();
+}
+
+EXPORT void hook_call(HookId hook, void * data)
+{
+    HookList * list = hook->get_list();
+    if (list)
+        call_list(hook, list, data);
 }
 
 EXPORT void hook_call(const char * name, void * data)
 {
     auto mh = mutex.take();
 
-    String key(name);
-    HookList * list = hooks.lookup(key);
+    HookData * hook = lookup(name, false);
+    HookList * list = hook ? hook->list.load() : nullptr;
     if (!list)
         return;
 
-    list->use_count++;
-
-    /* note: the list may grow (but not shrink) during the hook call */
-    for (int i = 0; i < list->items.len(); i++)
-    {
-        /* copy locally to prevent race condition */
-        HookItem item = list->items[i];
-
-        if (item.func)
-        {
-            mh.unlock();
-            item.func(data, item.user);
-            mh.lock();
-        }
-    }
-
-    list->use_count--;
+    /* the list cannot be replaced while the mutex is held */
+    list->refs++;
+    mh.unlock();
 
-    if (!list->use_count)
-    {
-        list->compact();
-        if (!list->items.len())
-            hooks.remove(key);
-    }
+    call_list(hook, list, data);
 }
 
 void hook_cleanup()
 {
     auto mh = mutex.take();
 
-    hooks.iterate([](const String & name, HookList & list) {
-        AUDWARN("Hook not disconnected: %s (%d)\n", (const char *)name,
-                list.items.len());
+    hooks.iterate([](const String & name, HookData *& hook) {
+        HookList * list = hook->list;
+        if (list)
+        {
+            AUDWARN("Hook not disconnected: %s (%d)\n", (const char *)name,
+                    list->items.len());
+            list->unref();
+        }
+
+        delete hook;
     });
 
     hooks.clear();
@@ -100,6 +100,19 @@ void hook_dissociate(const char * name, HookFunction func,
 /* Triggers the hook <name>. */
 void hook_call(const char * name, void * data);
 
+/* Handle to a hook, for hooks that are triggered often.  Calling a hook through
+ * its handle skips looking up the name each time.  A handle remains valid, even
+ * if no functions are associated with the hook, until libaudcore is shut down
+ * (in hook_cleanup()), so it must not be used after that. */
+struct HookData;
+typedef HookData * HookId;
+
+/* Returns the handle to the hook <name>. */
+HookId hook_find(const char * name);
+
+/* Triggers the hook <hook>. */
+void hook_call(HookId hook, void * data);
+
 typedef void (*EventDestroyFunc)(void * data);
 
 /* Schedules a call of the hook <name> from the program's main loop.
@@ -112,6 +125,10 @@ void event_queue(const char * name, void * data,
  * all hook calls matching <name> are canceled. */
 void event_queue_cancel(const char * name, void * data = nullptr);
 
+/* Like event_queue() and event_queue_cancel(), but with a hook handle. */
+void event_queue(HookId hook, void * data, EventDestroyFunc destroy = nullptr);
+void event_queue_cancel(HookId hook, void * data = nullptr);
+
 template<class T, class D>
 struct HookTarget
 {
@@ -31,6 +31,8 @@ class Plugin;
 class PluginHandle;
 class VFSFile;
 class Tuple;
+struct HookData;
+struct StereoVolume;
 
 typedef bool (*DirForeachFunc)(const char * path, const char * basename,
                                void * user);
@@ -42,10 +44,39 @@ void adder_cleanup();
 void art_cache_current(const String & filename, Index<char> && data,
                        String && art_file);
 void art_clear_current();
+void art_invalidate(const char * filename);
 void art_cleanup();
 
 /* art-search.cc */
 String art_search(const char * filename);
+void art_search_cleanup();
+
+/* audio.cc */
+enum class AudioImpl
+{
+    Scalar,
+    SSE2, /* 4 lanes */
+    AVX2, /* 8 lanes */
+    NEON  /* 4 lanes */
+};
+
+/* the fastest implementation is chosen automatically; these are for testing */
+bool audio_impl_supported(AudioImpl impl);
+void audio_set_impl(AudioImpl impl);
+
+/* The conversion stages of the output pipeline (see output.cc), fused into a
+ * single pass over the data: conversion from the input format with replay
+ * gain, and software volume (only if <volume> is not null), soft clipping and
+ * conversion to the output format.  For integer output, <data> is used as
+ * scratch space. */
+void audio_convert_input(const void * in, int format, float * out, int samples,
+                         float gain);
+void audio_convert_output(float * data, void * out, int format, int channels,
+                          int samples, const StereoVolume * volume,
+                          bool soft_clip);
+
+/* audstrings.cc */
+void str_append_collate_key(Index<char> & key, const char * str);
 
 /* charset.cc */
 void chardet_init();
@@ -89,9 +120,24 @@ void event_queue_unpause();
 void event_queue_cancel_all();
 
 /* fft.cc */
-void calc_freq(const float data[512], float freq[256]);
+#define FFT_MIN_SIZE 512
+#define FFT_MAX_SIZE 4096
+
+enum class FFTWindow
+{
+    Hamming,
+    Hann,
+    BlackmanHarris,
+    Rectangular,
+    count
+};
+
+/* size must be a power of 2 from FFT_MIN_SIZE to FFT_MAX_SIZE */
+void calc_freq(const float * data, float * freq, int size = FFT_MIN_SIZE,
+               FFTWindow window = FFTWindow::Hamming);
 
 /* hook.cc */
+HookData * hook_lookup(const char * name); /* nullptr if never used */
 void hook_cleanup();
 
 /* interface.cc */
@@ -105,6 +151,8 @@ void interface_run();
 void mainloop_cleanup();
 
 /* playback.cc */
+void playback_init();
+
 /* do not call these; use aud_drct_play/stop() instead */
 void playback_play(int seek_time, bool pause);
 void playback_stop(bool exiting = false);
@@ -125,6 +173,19 @@ int probe_by_filename(const char * filename);
 /* runtime.cc */
 extern size_t misc_bytes_allocated;
 
+/* scan-cache.cc */
+void scan_cache_load();
+void scan_cache_save();
+void scan_cache_cleanup();
+
+bool scan_cache_lookup(const char * filename, PluginHandle *& decoder,
+                       Tuple & tuple);
+void scan_cache_store(const char * filename, PluginHandle * decoder,
+                      const Tuple & tuple);
+PluginHandle * scan_cache_lookup_decoder(const char * filename);
+void scan_cache_store_decoder(const char * filename, PluginHandle * decoder);
+void scan_cache_invalidate(const char * filename);
+
 /* strpool.cc */
 void string_leak_check();
 
@@ -135,6 +196,7 @@ void timer_cleanup();
 const char * get_home_utf8();
 bool dir_foreach(const char * path, DirForeachFunc func, void * user_data);
 String write_temp_file(const void * data, int64_t len);
+bool local_file_stamp(const char * path, int64_t & mtime, int64_t & size);
 
 bool same_basename(const char * a, const char * b);
 const char * last_path_element(const char * path);
@@ -156,6 +218,13 @@ struct IntHashKey
     unsigned hash() const { return int32_hash(val); }
 };
 
+/* vfs_async.cc */
+void vfs_async_cleanup();
+
+/* vfs_local.cc */
+void vfs_prefetch(const char * filename);
+void vfs_prefetch_cleanup();
+
 /* vis-runner.cc */
 void vis_runner_start_stop(bool playing, bool paused);
 void vis_runner_pass_audio(int time, const Index<float> & data, int channels,
@@ -166,7 +235,9 @@ void vis_runner_enable(bool enable);
 /* visualization.cc */
 void vis_activate(bool activate);
 void vis_send_clear();
-void vis_send_audio(const float * data, int channels);
+void vis_send_audio(const float * data, int channels, const float * history,
+                    int history_frames);
+int vis_fft_size();
 
 bool vis_plugin_start(PluginHandle * plugin);
 void vis_plugin_stop(PluginHandle * plugin);
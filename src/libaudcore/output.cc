@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+
 #include "hook.h"
 #include "i18n.h"
 #include "interface.h"
@@ -158,6 +160,35 @@ static int64_t in_frames, out_bytes_written;
 static ReplayGainInfo gain_info;
 static bool gain_info_valid;
 
+/* The per-block processing settings are cached here rather than looked up in
+ * the config database for every block.  The "set" hooks only bump a serial
+ * number, so that the main thread never has to wait for the output lock; the
+ * settings are then reloaded before the next block is processed. */
+struct ProcessSettings
+{
+    int serial = -1;
+    float gain; /* replay gain factor, 1 if disabled */
+    bool sw_volume;
+    StereoVolume volume;
+    bool soft_clip;
+};
+
+static std::atomic<int> settings_serial;
+static ProcessSettings settings;
+
+static const char * const settings_hooks[] = {
+    "set enable_replay_gain",
+    "set replay_gain_mode",
+    "set replay_gain_preamp",
+    "set default_gain",
+    "set enable_clipping_prevention",
+    "set shuffle",
+    "set album_shuffle",
+    "set software_volume_control",
+    "set sw_volume_left",
+    "set sw_volume_right",
+    "set soft_clipping"};
+
 static Index<float> buffer1;
 static Index<char> buffer2;
 
@@ -358,10 +389,10 @@ static void flush_output(SafeLock &)
     vis_runner_flush();
 }
 
-static void apply_replay_gain(SafeLock &, Index<float> & data)
+static float get_replay_gain()
 {
     if (!aud_get_bool("enable_replay_gain"))
-        return;
+        return 1;
 
     float factor = powf(10, aud_get_double("replay_gain_preamp") / 20);
 
@@ -389,8 +420,44 @@ static void apply_replay_gain(SafeLock &, Index<float> & data)
     else
         factor *= powf(10, aud_get_double("default_gain") / 20);
 
-    if (factor < 0.99 || factor > 1.01)
-        audio_amplify(data.begin(), 1, data.len(), &factor);
+    return (factor < 0.99 || factor > 1.01) ? factor : 1;
+}
+
+static void update_settings(SafeLock &)
+{
+    int serial = settings_serial.load(std::memory_order_acquire);
+    if (settings.serial == serial)
+        return;
+
+    settings.serial = serial;
+    settings.gain = get_replay_gain();
+    settings.sw_volume = aud_get_bool("software_volume_control");
+    settings.volume = {aud_get_int("sw_volume_left"),
+                       aud_get_int("sw_volume_right")};
+    settings.soft_clip = aud_get_bool("soft_clipping");
+}
+
+static void invalidate_settings(SafeLock &) { settings.serial = -1; }
+
+static void settings_changed(void *, void *)
+{
+    settings_serial.fetch_add(1, std::memory_order_release);
+}
+
+/* The conversion stages after the effects (volume, clipping, and conversion to
+ * the output format) are done in a single pass over the data, as are
+ * conversion from the input format and replay gain. */
+static void convert_input(const void * data, float * out, int samples,
+                          float gain)
+{
+    audio_convert_input(data, in_format, out, samples, gain);
+}
+
+static void convert_output(float * data, void * out, int samples)
+{
+    audio_convert_output(data, out, out_format, out_channels, samples,
+                         settings.sw_volume ? &settings.volume : nullptr,
+                         settings.soft_clip);
 }
 
 static void write_secondary(SafeLock &, const Index<float> & data)
@@ -423,25 +490,18 @@ static void write_output(UnsafeLock & lock, Index<float> & data)
     if (state.secondary() && record_stream == OutputStream::AfterEqualizer)
         write_secondary(lock, data);
 
-    if (aud_get_bool("software_volume_control"))
-    {
-        StereoVolume v = {aud_get_int("sw_volume_left"),
-                          aud_get_int("sw_volume_right")};
-        audio_amplify(data.begin(), out_channels, data.len() / out_channels, v);
-    }
-
-    if (aud_get_bool("soft_clipping"))
-        audio_soft_clip(data.begin(), data.len());
+    update_settings(lock);
 
     const void * out_data = data.begin();
 
     if (out_format != FMT_FLOAT)
     {
         buffer2.resize(FMT_SIZEOF(out_format) * data.len());
-        audio_to_int(data.begin(), buffer2.begin(), out_format, data.len());
         out_data = buffer2.begin();
     }
 
+    convert_output(data.begin(), buffer2.begin(), data.len());
+
     out_bytes_held = FMT_SIZEOF(out_format) * data.len();
 
     while (out_bytes_held && !state.resetting())
@@ -497,16 +557,19 @@ static bool process_audio(UnsafeLock & lock, const void * data, int size,
     in_frames += samples / in_channels;
 
     buffer1.resize(samples);
-
-    if (in_format == FMT_FLOAT)
-        memcpy(buffer1.begin(), data, sizeof(float) * samples);
-    else
-        audio_from_int(data, in_format, buffer1.begin(), samples);
+    update_settings(lock);
 
     if (state.secondary() && record_stream == OutputStream::AsDecoded)
+    {
+        /* the stream must be recorded before replay gain is applied */
+        convert_input(data, buffer1.begin(), samples, 1);
         write_secondary(lock, buffer1);
 
-    apply_replay_gain(lock, buffer1);
+        if (settings.gain != 1)
+            audio_amplify(buffer1.begin(), 1, samples, &settings.gain);
+    }
+    else
+        convert_input(data, buffer1.begin(), samples, settings.gain);
 
     if (state.secondary() && record_stream == OutputStream::AfterReplayGain)
         write_secondary(lock, buffer1);
@@ -538,6 +601,7 @@ bool output_open_audio(const String & filename, const Tuple & tuple, int format,
 
     seek_time = start_time;
     gain_info_valid = false;
+    invalidate_settings(lock);
 
     in_filename = filename;
     in_tuple = tuple.ref();
@@ -571,6 +635,7 @@ void output_set_replay_gain(const ReplayGainInfo & info)
     {
         gain_info = info;
         gain_info_valid = true;
+        invalidate_settings(lock);
 
         AUDINFO("Replay Gain info:\n");
         AUDINFO(" album gain: %f dB\n", info.album_gain);
@@ -777,6 +842,7 @@ EXPORT void aud_drct_set_volume(StereoVolume volume)
     {
         aud_set_int("sw_volume_left", volume.left);
         aud_set_int("sw_volume_right", volume.right);
+        invalidate_settings(lock); /* don't wait for the hook */
     }
     else if (cop)
         cop->set_volume(volume);
@@ -832,10 +898,16 @@ void output_init()
 {
     hook_associate("set record", record_settings_changed, nullptr);
     hook_associate("set record_stream", record_settings_changed, nullptr);
+
+    for (const char * name : settings_hooks)
+        hook_associate(name, settings_changed, nullptr);
 }
 
 void output_cleanup()
 {
     hook_dissociate("set record", record_settings_changed);
     hook_dissociate("set record_stream", record_settings_changed);
+
+    for (const char * name : settings_hooks)
+        hook_dissociate(name, settings_changed);
 }
@@ -91,6 +91,9 @@ struct PlaybackInfo
     bool ended = false;
     bool error = false;
     String error_s;
+
+    bool prefetched = false;
+    bool preloaded = false;
 };
 
 static aud::mutex mutex;
@@ -100,10 +103,18 @@ static PlaybackState pb_state;
 static PlaybackControl pb_control;
 static PlaybackInfo pb_info;
 
+// the next song's file is prefetched this long before the end of a song
+#define PREFETCH_LEAD 10000 // milliseconds
+// and its decoder and file are opened this long before the end
+#define PRELOAD_LEAD 3000 // milliseconds
+
 static QueuedFunc end_queue;
 static bool song_finished = false;
 static int failed_entries = 0;
 
+// queued on every seek, so looked up only once
+static HookId seek_hook;
+
 // check that the playback thread is not lagging
 static bool in_sync(aud::mutex::holder &)
 {
@@ -117,6 +128,8 @@ static bool is_ready(aud::mutex::holder & mh)
     return in_sync(mh) && pb_info.ready;
 }
 
+void playback_init() { seek_hook = hook_find("playback seek"); }
+
 // called by playback_entry_set_tuple() to ensure that the tuple still applies
 // to the current song from the perspective of the main/playlist thread; the
 // check is necessary because playback_entry_set_tuple() is itself called from
@@ -173,7 +186,7 @@ static void playback_cleanup(aud::mutex::holder &)
     event_queue_cancel("playback ready");
     event_queue_cancel("playback pause");
     event_queue_cancel("playback unpause");
-    event_queue_cancel("playback seek");
+    event_queue_cancel(seek_hook);
     event_queue_cancel("info change");
     event_queue_cancel("title change");
     event_queue_cancel("tuple change");
@@ -265,7 +278,7 @@ static void request_seek(aud::mutex::holder & mh, int time)
     if (is_ready(mh) && pb_info.length > 0)
     {
         output_flush(aud::clamp(time, 0, pb_info.length));
-        event_queue("playback seek", nullptr);
+        event_queue(seek_hook, nullptr);
     }
 }
 
@@ -323,7 +336,7 @@ static bool check_playback_repeat()
         if (pb_info.time_offset > 0 && pb_control.seek < 0)
             pb_control.seek = 0;
 
-        event_queue("playback seek", nullptr);
+        event_queue(seek_hook, nullptr);
         pb_info.ended = false;
         return true;
     }
@@ -545,8 +558,42 @@ EXPORT void InputPlugin::write_audio(const void * data, int length)
     int a = pb_control.repeat_a;
     int b = pb_control.repeat_b;
 
+    // check whether to prefetch or preload the next song
+    int serial = pb_state.playback_serial;
+    int song_length = pb_info.length;
+    bool prefetch = (!pb_info.prefetched && song_length > 0);
+    bool preload = (!pb_info.preloaded && song_length > 0);
+
     mh.unlock();
 
+    if (prefetch || preload)
+    {
+        int time = output_get_time();
+        prefetch = prefetch && time >= song_length - PREFETCH_LEAD;
+        preload = preload && time >= song_length - PRELOAD_LEAD;
+
+        if (prefetch || preload)
+        {
+            mh.lock();
+
+            // the song may have changed while the mutex was unlocked
+            if (in_sync(mh) && pb_state.playback_serial == serial)
+            {
+                pb_info.prefetched |= prefetch;
+                pb_info.preloaded |= preload;
+            }
+            else
+                prefetch = preload = false;
+
+            mh.unlock();
+        }
+
+        if (prefetch)
+            playback_entry_prefetch_next(serial);
+        if (preload)
+            playback_entry_preload_next(serial);
+    }
+
     // it's okay to call output_write_audio() even if we are no longer in sync,
     // since it will return immediately if output_flush() has been called
     int stop_time = (b >= 0) ? b : pb_info.stop_time;
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "internal.h"
 #include "runtime.h"
 #include "scanner.h"
 #include "tuple-compiler.h"
@@ -34,6 +35,7 @@
 static TupleCompiler s_tuple_formatter;
 static bool s_use_tuple_fallbacks = false;
 
+/* The remaining per-entry fields are stored in PlaylistData; see there. */
 struct PlaylistEntry
 {
     PlaylistEntry(PlaylistAddItem && item);
@@ -41,15 +43,13 @@ struct PlaylistEntry
 
     void format();
     void set_tuple(Tuple && new_tuple);
+    int length() const { return aud::max(0, tuple.get_int(Tuple::Length)); }
 
     String filename;
     PluginHandle * decoder;
     Tuple tuple;
     String error;
-    int number;
-    int length;
-    int shuffle_num;
-    bool selected, queued;
+    int number; /* row in PlaylistData */
 };
 
 void PlaylistEntry::format()
@@ -79,15 +79,13 @@ void PlaylistEntry::set_tuple(Tuple && new_tuple)
     if (!new_tuple.valid())
         new_tuple.set_filename(filename);
 
-    length = aud::max(0, new_tuple.get_int(Tuple::Length));
     tuple = std::move(new_tuple);
 
     format();
 }
 
 PlaylistEntry::PlaylistEntry(PlaylistAddItem && item)
-    : filename(item.filename), decoder(item.decoder), number(-1), length(0),
-      shuffle_num(0), selected(false), queued(false)
+    : filename(item.filename), decoder(item.decoder), number(-1)
 {
     set_tuple(std::move(item.tuple));
 }
@@ -112,9 +110,11 @@ void PlaylistData::delete_entry(PlaylistEntry * entry) // static
 
 PlaylistData::PlaylistData(Playlist::ID * id, const char * title)
     : modified(true), scan_status(NotScanning), title(title), resume_time(0),
-      m_id(id), m_position(nullptr), m_focus(nullptr), m_selected_count(0),
-      m_last_shuffle_num(0), m_total_length(0), m_selected_length(0),
-      m_last_update(), m_next_update(), m_position_changed(false)
+      m_id(id), m_serial(0), m_select_serial(0), m_position(nullptr),
+      m_focus(nullptr), m_next_random(nullptr), m_next_random_repeated(false),
+      m_selected_count(0), m_last_shuffle_num(0), m_total_length(0),
+      m_selected_length(0), m_last_update(), m_next_update(),
+      m_position_changed(false)
 {
 }
 
@@ -126,6 +126,80 @@ void PlaylistData::number_entries(int at, int length)
         m_entries[i]->number = i;
 }
 
+void PlaylistData::insert_rows(int at, int number)
+{
+    m_selection_tree.invalidate();
+    m_serial++;
+
+    m_entries.insert(at, number);
+    m_lengths.insert(at, number);
+    m_shuffle_nums.insert(at, number);
+    m_selected.insert(at, number);
+    m_in_queue.insert(at, number);
+}
+
+void PlaylistData::remove_rows(int at, int number)
+{
+    m_selection_tree.invalidate();
+    m_serial++;
+
+    m_entries.remove(at, number);
+    m_lengths.remove(at, number);
+    m_shuffle_nums.remove(at, number);
+    m_selected.remove(at, number);
+    m_in_queue.remove(at, number);
+}
+
+void PlaylistData::swap_rows(int a, int b)
+{
+    m_selection_tree.invalidate();
+    m_serial++;
+
+    std::swap(m_entries[a], m_entries[b]);
+    std::swap(m_lengths[a], m_lengths[b]);
+    std::swap(m_shuffle_nums[a], m_shuffle_nums[b]);
+    std::swap(m_selected[a], m_selected[b]);
+    std::swap(m_in_queue[a], m_in_queue[b]);
+}
+
+/* overwrites (deleting) the entry at <to> */
+void PlaylistData::move_row(int from, int to)
+{
+    m_selection_tree.invalidate();
+    m_serial++;
+
+    m_entries[to] = std::move(m_entries[from]);
+    m_lengths[to] = m_lengths[from];
+    m_shuffle_nums[to] = m_shuffle_nums[from];
+    m_selected[to] = m_selected[from];
+    m_in_queue[to] = m_in_queue[from];
+}
+
+template<class T>
+static void reorder_column(Index<T> & column, int at, const Index<int> & order)
+{
+    Index<T> temp;
+    temp.insert(0, order.len());
+
+    for (int i = 0; i < order.len(); i++)
+        temp[i] = std::move(column[order[i]]);
+    for (int i = 0; i < order.len(); i++)
+        column[at + i] = std::move(temp[i]);
+}
+
+/* order[i] is the current row of the entry to be placed at row at + i */
+void PlaylistData::reorder_rows(int at, const Index<int> & order)
+{
+    m_selection_tree.invalidate();
+    m_serial++;
+
+    reorder_column(m_entries, at, order);
+    reorder_column(m_lengths, at, order);
+    reorder_column(m_shuffle_nums, at, order);
+    reorder_column(m_selected, at, order);
+    reorder_column(m_in_queue, at, order);
+}
+
 PlaylistEntry * PlaylistData::entry_at(int i)
 {
     return (i >= 0 && i < m_entries.len()) ? m_entries[i].get() : nullptr;
@@ -136,6 +210,11 @@ const PlaylistEntry * PlaylistData::entry_at(int i) const
     return (i >= 0 && i < m_entries.len()) ? m_entries[i].get() : nullptr;
 }
 
+int PlaylistData::entry_number(const PlaylistEntry * entry) // static
+{
+    return entry->number;
+}
+
 String PlaylistData::entry_filename(int i) const
 {
     auto entry = entry_at(i);
@@ -166,15 +245,16 @@ static bool same_album(const Tuple & a, const Tuple & b)
 
 void PlaylistData::set_entry_tuple(PlaylistEntry * entry, Tuple && tuple)
 {
-    m_total_length -= entry->length;
-    if (entry->selected)
-        m_selected_length -= entry->length;
+    int row = entry->number;
+    int old_length = m_lengths[row];
 
     entry->set_tuple(std::move(tuple));
 
-    m_total_length += entry->length;
-    if (entry->selected)
-        m_selected_length += entry->length;
+    int length = entry->length();
+    m_lengths[row] = length;
+    m_total_length += length - old_length;
+    if (m_selected[row])
+        m_selected_length += length - old_length;
 }
 
 void PlaylistData::queue_update(Playlist::UpdateLevel level, int at, int count,
@@ -229,14 +309,16 @@ void PlaylistData::insert_items(int at, Index<PlaylistAddItem> && items)
     if (at < 0 || at > n_entries)
         at = n_entries;
 
-    m_entries.insert(at, n_items);
+    insert_rows(at, n_items);
 
     int i = at;
     for (auto & item : items)
     {
         auto entry = new PlaylistEntry(std::move(item));
-        m_entries[i++].capture(entry);
-        m_total_length += entry->length;
+        m_entries[i].capture(entry);
+        m_lengths[i] = entry->length();
+        m_total_length += m_lengths[i];
+        i++;
     }
 
     items.clear();
@@ -273,26 +355,28 @@ void PlaylistData::remove_entries(int at, int number)
             m_focus = nullptr;
     }
 
-    for (int i = 0; i < number; i++)
-    {
-        PlaylistEntry * entry = m_entries[at + i].get();
+    if (m_next_random && m_next_random->number >= at &&
+        m_next_random->number < at + number)
+        m_next_random = nullptr;
 
-        if (entry->queued)
+    for (int row = at; row < at + number; row++)
+    {
+        if (m_in_queue[row])
         {
-            m_queued.remove(m_queued.find(entry), 1);
+            m_queued.remove(m_queued.find(m_entries[row].get()), 1);
             update_flags |= QueueChanged;
         }
 
-        if (entry->selected)
+        if (m_selected[row])
         {
             m_selected_count--;
-            m_selected_length -= entry->length;
+            m_selected_length -= m_lengths[row];
         }
 
-        m_total_length -= entry->length;
+        m_total_length -= m_lengths[row];
     }
 
-    m_entries.remove(at, number);
+    remove_rows(at, number);
 
     number_entries(at, n_entries - at - number);
     queue_update(Playlist::Structure, at, 0, update_flags);
@@ -315,8 +399,9 @@ int PlaylistData::focus() const { return m_focus ? m_focus->number : -1; }
 
 bool PlaylistData::entry_selected(int entry_num) const
 {
-    auto entry = entry_at(entry_num);
-    return entry ? entry->selected : false;
+    return (entry_num >= 0 && entry_num < m_entries.len())
+               ? m_selected[entry_num]
+               : false;
 }
 
 int PlaylistData::n_selected(int at, int number) const
@@ -328,20 +413,10 @@ int PlaylistData::n_selected(int at, int number) const
     if (number < 0 || number > n_entries - at)
         number = n_entries - at;
 
-    int n_selected = 0;
-
     if (at == 0 && number == n_entries)
-        n_selected = m_selected_count;
-    else
-    {
-        for (int i = 0; i < number; i++)
-        {
-            if (m_entries[at + i]->selected)
-                n_selected++;
-        }
-    }
+        return m_selected_count;
 
-    return n_selected;
+    return m_selection_tree.count(m_selected, at, number);
 }
 
 void PlaylistData::set_focus(int entry_num)
@@ -373,21 +448,23 @@ void PlaylistData::set_focus(int entry_num)
 
 void PlaylistData::select_entry(int entry_num, bool selected)
 {
-    auto entry = entry_at(entry_num);
-    if (!entry || entry->selected == selected)
+    if (entry_num < 0 || entry_num >= m_entries.len() ||
+        m_selected[entry_num] == selected)
         return;
 
-    entry->selected = selected;
+    m_selected[entry_num] = selected;
+    m_selection_tree.set(entry_num, selected);
+    m_select_serial++;
 
     if (selected)
     {
         m_selected_count++;
-        m_selected_length += entry->length;
+        m_selected_length += m_lengths[entry_num];
     }
     else
     {
         m_selected_count--;
-        m_selected_length -= entry->length;
+        m_selected_length -= m_lengths[entry_num];
     }
 
     queue_update(Playlist::Selection, entry_num, 1);
@@ -398,16 +475,22 @@ void PlaylistData::select_all(bool selected)
     int n_entries = m_entries.len();
     int first = n_entries, last = 0;
 
-    for (auto & entry : m_entries)
+    if (m_selected_count == (selected ? n_entries : 0))
+        return;
+
+    for (int row = 0; row < n_entries; row++)
     {
-        if (entry->selected != selected)
+        if (m_selected[row] != selected)
         {
-            entry->selected = selected;
-            first = aud::min(first, entry->number);
-            last = entry->number;
+            m_selected[row] = selected;
+            first = aud::min(first, row);
+            last = row;
         }
     }
 
+    m_selection_tree.fill(n_entries, selected);
+    m_select_serial++;
+
     if (selected)
     {
         m_selected_count = n_entries;
@@ -425,8 +508,7 @@ void PlaylistData::select_all(bool selected)
 
 int PlaylistData::shift_entries(int entry_num, int distance)
 {
-    PlaylistEntry * entry = entry_at(entry_num);
-    if (!entry || !entry->selected || !distance)
+    if (!entry_selected(entry_num) || !distance)
         return 0;
 
     int n_entries = m_entries.len();
@@ -436,7 +518,7 @@ int PlaylistData::shift_entries(int entry_num, int distance)
     {
         for (center = entry_num; center > 0 && shift > distance;)
         {
-            if (!m_entries[--center]->selected)
+            if (!m_selected[--center])
                 shift--;
         }
     }
@@ -444,7 +526,7 @@ int PlaylistData::shift_entries(int entry_num, int distance)
     {
         for (center = entry_num + 1; center < n_entries && shift < distance;)
         {
-            if (!m_entries[center++]->selected)
+            if (!m_selected[center++])
                 shift++;
         }
     }
@@ -453,37 +535,37 @@ int PlaylistData::shift_entries(int entry_num, int distance)
 
     for (int i = 0; i < top; i++)
     {
-        if (m_entries[i]->selected)
+        if (m_selected[i])
             top = i;
     }
 
     for (int i = n_entries; i > bottom; i--)
     {
-        if (m_entries[i - 1]->selected)
+        if (m_selected[i - 1])
             bottom = i;
     }
 
-    Index<EntryPtr> temp;
+    Index<int> order;
 
     for (int i = top; i < center; i++)
     {
-        if (!m_entries[i]->selected)
-            temp.append(std::move(m_entries[i]));
+        if (!m_selected[i])
+            order.append(i);
     }
 
     for (int i = top; i < bottom; i++)
     {
-        if (m_entries[i] && m_entries[i]->selected)
-            temp.append(std::move(m_entries[i]));
+        if (m_selected[i])
+            order.append(i);
     }
 
     for (int i = center; i < bottom; i++)
     {
-        if (m_entries[i] && !m_entries[i]->selected)
-            temp.append(std::move(m_entries[i]));
+        if (!m_selected[i])
+            order.append(i);
     }
 
-    m_entries.move_from(temp, 0, top, bottom - top, false, true);
+    reorder_rows(top, order);
 
     number_entries(top, bottom - top);
     queue_update(Playlist::Structure, top, bottom - top);
@@ -500,7 +582,7 @@ void PlaylistData::remove_selected()
     bool position_changed = false;
     int update_flags = 0;
 
-    if (m_position && m_position->selected)
+    if (m_position && m_selected[m_position->number])
     {
         change_position(NO_POS);
         position_changed = true;
@@ -511,35 +593,33 @@ void PlaylistData::remove_selected()
     int before = 0; // number of entries before first selected
     int after = 0;  // number of entries after last selected
 
-    while (before < n_entries && !m_entries[before]->selected)
+    while (before < n_entries && !m_selected[before])
         before++;
 
     int to = before;
 
     for (int from = before; from < n_entries; from++)
     {
-        PlaylistEntry * entry = m_entries[from].get();
-
-        if (entry->selected)
+        if (m_selected[from])
         {
-            if (entry->queued)
+            if (m_in_queue[from])
             {
-                m_queued.remove(m_queued.find(entry), 1);
+                m_queued.remove(m_queued.find(m_entries[from].get()), 1);
                 update_flags |= QueueChanged;
             }
 
-            m_total_length -= entry->length;
+            m_total_length -= m_lengths[from];
             after = 0;
         }
         else
         {
-            m_entries[to++] = std::move(m_entries[from]);
+            move_row(from, to++);
             after++;
         }
     }
 
     n_entries = to;
-    m_entries.remove(n_entries, -1);
+    remove_rows(n_entries, m_entries.len() - n_entries);
 
     m_selected_count = 0;
     m_selected_length = 0;
@@ -557,48 +637,69 @@ void PlaylistData::remove_selected()
     }
 }
 
-void PlaylistData::sort_entries(Index<EntryPtr> & entries,
-                                const CompareData & data) // static
+void PlaylistData::get_sort_items(const CompareData & data,
+                                  bool selected_only, SortItems & items) const
 {
-    entries.sort([data](const EntryPtr & a, const EntryPtr & b) {
+    items.serial = m_serial;
+    items.select_serial = m_select_serial;
+    items.selected_only = selected_only;
+
+    for (int row = 0; row < m_entries.len(); row++)
+    {
+        if (selected_only && !m_selected[row])
+            continue;
+
+        items.rows.append(row);
+
         if (data.filename_compare)
-            return data.filename_compare(a->filename, b->filename);
+            items.filenames.append(m_entries[row]->filename);
         else
-            return data.tuple_compare(a->tuple, b->tuple);
-    });
+            items.tuples.append(m_entries[row]->tuple.ref());
+    }
 }
 
-void PlaylistData::sort(const CompareData & data)
+bool PlaylistData::apply_sort(const SortItems & items, const Index<int> & order)
 {
-    sort_entries(m_entries, data);
-
-    number_entries(0, m_entries.len());
-    queue_update(Playlist::Structure, 0, m_entries.len());
-}
+    if (items.serial != m_serial ||
+        (items.selected_only && items.select_serial != m_select_serial))
+        return false;
 
-void PlaylistData::sort_selected(const CompareData & data)
-{
     int n_entries = m_entries.len();
 
-    Index<EntryPtr> selected;
+    /* new_rows[i] is the current row of the entry to be placed at row i */
+    Index<int> new_rows;
+    new_rows.insert(0, n_entries);
 
-    for (auto & entry : m_entries)
+    /* unselected entries stay in place */
+    if (items.selected_only)
     {
-        if (entry->selected)
-            selected.append(std::move(entry));
+        for (int i = 0; i < n_entries; i++)
+            new_rows[i] = i;
     }
 
-    sort_entries(selected, data);
+    for (int i = 0; i < order.len(); i++)
+        new_rows[items.rows[i]] = items.rows[order[i]];
 
-    int i = 0;
-    for (auto & entry : m_entries)
-    {
-        if (!entry)
-            entry = std::move(selected[i++]);
-    }
+    reorder_rows(0, new_rows);
 
     number_entries(0, n_entries);
     queue_update(Playlist::Structure, 0, n_entries);
+
+    return true;
+}
+
+void PlaylistData::sort(const CompareData & data)
+{
+    SortItems items;
+    get_sort_items(data, false, items);
+    apply_sort(items, sort_items(items, data));
+}
+
+void PlaylistData::sort_selected(const CompareData & data)
+{
+    SortItems items;
+    get_sort_items(data, true, items);
+    apply_sort(items, sort_items(items, data));
 }
 
 void PlaylistData::reverse_order()
@@ -606,7 +707,7 @@ void PlaylistData::reverse_order()
     int n_entries = m_entries.len();
 
     for (int i = 0; i < n_entries / 2; i++)
-        std::swap(m_entries[i], m_entries[n_entries - 1 - i]);
+        swap_rows(i, n_entries - 1 - i);
 
     number_entries(0, n_entries);
     queue_update(Playlist::Structure, 0, n_entries);
@@ -621,15 +722,15 @@ void PlaylistData::reverse_selected()
 
     while (1)
     {
-        while (top < bottom && !m_entries[top]->selected)
+        while (top < bottom && !m_selected[top])
             top++;
-        while (top < bottom && !m_entries[bottom]->selected)
+        while (top < bottom && !m_selected[bottom])
             bottom--;
 
         if (top >= bottom)
             break;
 
-        std::swap(m_entries[top++], m_entries[bottom--]);
+        swap_rows(top++, bottom--);
     }
 
     number_entries(0, n_entries);
@@ -641,7 +742,7 @@ void PlaylistData::randomize_order()
     int n_entries = m_entries.len();
 
     for (int i = 0; i < n_entries; i++)
-        std::swap(m_entries[i], m_entries[rand() % n_entries]);
+        swap_rows(i, rand() % n_entries);
 
     number_entries(0, n_entries);
     queue_update(Playlist::Structure, 0, n_entries);
@@ -651,22 +752,19 @@ void PlaylistData::randomize_selected()
 {
     int n_entries = m_entries.len();
 
-    Index<PlaylistEntry *> selected;
+    Index<int> selected;
 
-    for (auto & entry : m_entries)
+    for (int i = 0; i < n_entries; i++)
     {
-        if (entry->selected)
-            selected.append(entry.get());
+        if (m_selected[i])
+            selected.append(i);
     }
 
     int n_selected = selected.len();
 
+    /* the selected rows stay the same, only their contents are shuffled */
     for (int i = 0; i < n_selected; i++)
-    {
-        int a = selected[i]->number;
-        int b = selected[rand() % n_selected]->number;
-        std::swap(m_entries[a], m_entries[b]);
-    }
+        swap_rows(selected[i], selected[rand() % n_selected]);
 
     number_entries(0, n_entries);
     queue_update(Playlist::Structure, 0, n_entries);
@@ -680,14 +778,15 @@ int PlaylistData::queue_get_entry(int at) const
 int PlaylistData::queue_find_entry(int entry_num) const
 {
     auto entry = entry_at(entry_num);
-    return (entry && entry->queued) ? m_queued.find((PlaylistEntry *)entry)
-                                    : -1;
+    return (entry && m_in_queue[entry_num])
+               ? m_queued.find((PlaylistEntry *)entry)
+               : -1;
 }
 
 void PlaylistData::queue_insert(int at, int entry_num)
 {
     auto entry = entry_at(entry_num);
-    if (!entry || entry->queued)
+    if (!entry || m_in_queue[entry_num])
         return;
 
     if (at < 0 || at > m_queued.len())
@@ -698,7 +797,7 @@ void PlaylistData::queue_insert(int at, int entry_num)
         m_queued[at] = entry;
     }
 
-    entry->queued = true;
+    m_in_queue[entry_num] = true;
 
     queue_update(Playlist::Selection, entry_num, 1, QueueChanged);
 }
@@ -712,15 +811,15 @@ void PlaylistData::queue_insert_selected(int at)
     int first = m_entries.len();
     int last = 0;
 
-    for (auto & entry : m_entries)
+    for (int row = 0; row < m_entries.len(); row++)
     {
-        if (!entry->selected || entry->queued)
+        if (!m_selected[row] || m_in_queue[row])
             continue;
 
-        add.append(entry.get());
-        entry->queued = true;
-        first = aud::min(first, entry->number);
-        last = entry->number;
+        add.append(m_entries[row].get());
+        m_in_queue[row] = true;
+        first = aud::min(first, row);
+        last = row;
     }
 
     m_queued.move_from(add, 0, at, -1, true, true);
@@ -745,7 +844,7 @@ void PlaylistData::queue_remove(int at, int number)
     for (int i = at; i < at + number; i++)
     {
         PlaylistEntry * entry = m_queued[i];
-        entry->queued = false;
+        m_in_queue[entry->number] = false;
         first = aud::min(first, entry->number);
         last = entry->number;
     }
@@ -766,10 +865,10 @@ void PlaylistData::queue_remove_selected()
     {
         PlaylistEntry * entry = m_queued[i];
 
-        if (entry->selected)
+        if (m_selected[entry->number])
         {
             m_queued.remove(i, 1);
-            entry->queued = false;
+            m_in_queue[entry->number] = false;
             first = aud::min(first, entry->number);
             last = entry->number;
         }
@@ -784,22 +883,23 @@ void PlaylistData::queue_remove_selected()
 
 int PlaylistData::shuffle_pos_before(int ref_pos) const
 {
-    auto ref_entry = entry_at(ref_pos);
-    if (!ref_entry)
+    if (!entry_at(ref_pos))
         return -1;
 
-    const PlaylistEntry * found = nullptr;
-    for (auto & entry : m_entries)
+    int ref_num = m_shuffle_nums[ref_pos];
+    int found = -1;
+
+    for (int row = 0; row < m_entries.len(); row++)
     {
-        if (entry->shuffle_num > 0 &&
-            entry->shuffle_num < ref_entry->shuffle_num &&
-            (!found || entry->shuffle_num > found->shuffle_num))
+        int num = m_shuffle_nums[row];
+        if (num > 0 && num < ref_num &&
+            (found < 0 || num > m_shuffle_nums[found]))
         {
-            found = entry.get();
+            found = row;
         }
     }
 
-    return found ? found->number : -1;
+    return found;
 }
 
 PlaylistData::PosChange PlaylistData::shuffle_pos_after(int ref_pos,
@@ -812,21 +912,20 @@ PlaylistData::PosChange PlaylistData::shuffle_pos_after(int ref_pos,
     // the reference entry can be beyond the end of the shuffle list
     // if we are looking ahead multiple entries, as in next_album()
     // (2026-Apr: not true anymore, but leaving the check anyway)
-    if (ref_entry->shuffle_num > 0)
+    int ref_num = m_shuffle_nums[ref_pos];
+    if (ref_num > 0)
     {
         // look for the next entry in the existing shuffle order
-        const PlaylistEntry * next = nullptr;
-        for (auto & entry : m_entries)
+        int next = -1;
+        for (int row = 0; row < m_entries.len(); row++)
         {
-            if (entry->shuffle_num > ref_entry->shuffle_num &&
-                (!next || entry->shuffle_num < next->shuffle_num))
-            {
-                next = entry.get();
-            }
+            int num = m_shuffle_nums[row];
+            if (num > ref_num && (next < 0 || num < m_shuffle_nums[next]))
+                next = row;
         }
 
-        if (next)
-            return {next->number, false};
+        if (next >= 0)
+            return {next, false};
     }
 
     if (by_album)
@@ -843,29 +942,48 @@ PlaylistData::PosChange PlaylistData::shuffle_pos_after(int ref_pos,
 PlaylistData::PosChange PlaylistData::shuffle_pos_random(bool repeat,
                                                          bool by_album) const
 {
-    Index<const PlaylistEntry *> choices;
+    Index<int> choices;
     const PlaylistEntry * prev_entry = nullptr;
 
-    for (auto & entry : m_entries)
+    for (int row = 0; row < m_entries.len(); row++)
     {
+        auto entry = m_entries[row].get();
+
         // skip already played entries (unless repeating)
         // optionally skip all but first entry in album
-        if ((entry->shuffle_num == 0 || repeat) &&
+        if ((m_shuffle_nums[row] == 0 || repeat) &&
             !(by_album && prev_entry &&
               same_album(entry->tuple, prev_entry->tuple)))
         {
-            choices.append(entry.get());
+            choices.append(row);
         }
 
-        prev_entry = entry.get();
+        prev_entry = entry;
     }
 
     if (choices.len())
-        return {choices[rand() % choices.len()]->number, true};
+        return {choices[rand() % choices.len()], true};
 
     return NO_POS;
 }
 
+// returns the random entry already picked by predict_next_song(), if it is
+// still a valid choice (i.e. it has not been played in the meantime)
+PlaylistData::PosChange PlaylistData::next_random_pos(bool repeat,
+                                                      bool & repeated) const
+{
+    if (!m_next_random || m_queued.len())
+        return NO_POS;
+
+    int pos = m_next_random->number;
+    repeated = m_next_random_repeated;
+
+    if (repeated ? !repeat : m_shuffle_nums[pos] != 0)
+        return NO_POS;
+
+    return {pos, true};
+}
+
 int PlaylistData::pos_before(int ref_pos, bool shuffle, bool repeat) const
 {
     if (shuffle)
@@ -934,13 +1052,13 @@ void PlaylistData::change_position(PosChange change)
 
     /* move entry to top of shuffle list */
     if (m_position && change.update_shuffle)
-        m_position->shuffle_num = ++m_last_shuffle_num;
+        m_shuffle_nums[change.new_pos] = ++m_last_shuffle_num;
 
     /* remove from queue if it's the first entry */
     if (m_queued.len() && m_position == m_queued[0])
     {
         m_queued.remove(0, 1);
-        m_position->queued = false;
+        m_in_queue[m_position->number] = false;
         queue_update(Playlist::Selection, m_position->number, 1, QueueChanged);
     }
 }
@@ -952,11 +1070,17 @@ bool PlaylistData::change_position_to_next(bool repeat, int hint_pos)
     bool repeated = false;
 
     auto change = pos_after(position(), shuffle, by_album);
+
+    // play the entry that was picked (and preloaded) ahead of time
+    if (change.new_pos < 0 && shuffle)
+        change = next_random_pos(repeat, repeated);
     if (change.new_pos < 0)
         change = pos_new_full(repeat, shuffle, by_album, hint_pos, repeated);
     if (change.new_pos < 0)
         return false;
 
+    m_next_random = nullptr;
+
     if (repeated)
         shuffle_reset();
 
@@ -968,8 +1092,8 @@ void PlaylistData::shuffle_reset()
 {
     m_last_shuffle_num = 0;
 
-    for (auto & entry : m_entries)
-        entry->shuffle_num = 0;
+    for (int & num : m_shuffle_nums)
+        num = 0;
 }
 
 Index<int> PlaylistData::shuffle_history() const
@@ -977,16 +1101,15 @@ Index<int> PlaylistData::shuffle_history() const
     Index<int> history;
 
     // create a list of all entries in the shuffle list
-    for (auto & entry : m_entries)
+    for (int row = 0; row < m_entries.len(); row++)
     {
-        if (entry->shuffle_num)
-            history.append(entry->number);
+        if (m_shuffle_nums[row])
+            history.append(row);
     }
 
     // sort by shuffle order
     history.sort([this](int entry_a, int entry_b) {
-        return m_entries[entry_a]->shuffle_num -
-               m_entries[entry_b]->shuffle_num;
+        return m_shuffle_nums[entry_a] - m_shuffle_nums[entry_b];
     });
 
     return history;
@@ -999,9 +1122,8 @@ void PlaylistData::shuffle_replay(const Index<int> & history)
     // replay the given history, entry by entry
     for (int entry_num : history)
     {
-        auto entry = entry_at(entry_num);
-        if (entry)
-            entry->shuffle_num = ++m_last_shuffle_num;
+        if (entry_at(entry_num))
+            m_shuffle_nums[entry_num] = ++m_last_shuffle_num;
     }
 }
 
@@ -1033,6 +1155,30 @@ bool PlaylistData::next_song(bool repeat)
     return true;
 }
 
+// returns the entry that next_song() will move to, or -1 if there is none;
+// in shuffle mode, a random choice is made now and kept for next_song()
+int PlaylistData::predict_next_song(bool repeat)
+{
+    bool shuffle = aud_get_bool("shuffle");
+    bool by_album = aud_get_bool("album_shuffle");
+    bool repeated;
+
+    auto change = pos_after(position(), shuffle, by_album);
+    if (change.new_pos < 0 && shuffle)
+        change = next_random_pos(repeat, repeated);
+    if (change.new_pos < 0)
+    {
+        change = pos_new_full(repeat, shuffle, by_album, -1, repeated);
+        if (shuffle && !m_queued.len())
+        {
+            m_next_random = entry_at(change.new_pos);
+            m_next_random_repeated = repeated;
+        }
+    }
+
+    return change.new_pos;
+}
+
 bool PlaylistData::prev_album(bool repeat)
 {
     bool shuffle = aud_get_bool("shuffle");
@@ -1093,7 +1239,7 @@ bool PlaylistData::next_album(bool repeat)
         // important to prevent pos_after() from going backward in the
         // shuffle list, causing an infinite back-and-forth loop
         if (change.update_shuffle)
-            next_entry->shuffle_num = ++m_last_shuffle_num;
+            m_shuffle_nums[change.new_pos] = ++m_last_shuffle_num;
     }
 
     // get one new position if there was nothing after the album
@@ -1200,8 +1346,12 @@ void PlaylistData::reset_tuples(bool selected_only)
 {
     for (auto & entry : m_entries)
     {
-        if (!selected_only || entry->selected)
+        if (!selected_only || m_selected[entry->number])
+        {
+            scan_cache_invalidate(entry->filename);
+            art_invalidate(entry->filename);
             set_entry_tuple(entry.get(), Tuple());
+        }
     }
 
     queue_update(Playlist::Metadata, 0, m_entries.len());
@@ -1228,20 +1378,20 @@ void PlaylistData::reset_tuple_of_file(const char * filename)
 
 PlaylistEntry * PlaylistData::find_unselected_focus()
 {
-    if (!m_focus || !m_focus->selected)
+    if (!m_focus || !m_selected[m_focus->number])
         return m_focus;
 
     int n_entries = m_entries.len();
 
     for (int search = m_focus->number + 1; search < n_entries; search++)
     {
-        if (!m_entries[search]->selected)
+        if (!m_selected[search])
             return m_entries[search].get();
     }
 
     for (int search = m_focus->number; search--;)
     {
-        if (!m_entries[search]->selected)
+        if (!m_selected[search])
             return m_entries[search].get();
     }
 
@@ -22,6 +22,7 @@
 
 #include "playlist.h"
 #include "scanner.h"
+#include "selection-tree.h"
 
 class TupleCompiler;
 struct PlaylistEntry;
@@ -48,6 +49,23 @@ public:
     {
         Playlist::StringCompareFunc filename_compare;
         Playlist::TupleCompareFunc tuple_compare;
+        /* if set, entries are sorted by precomputed keys built from this
+         * field, which must give the same order as tuple_compare */
+        Tuple::Field key_field = Tuple::Invalid;
+        /* if set, the compare functions may be called from several threads at
+         * once; functions passed in by plugins are only called from one */
+        bool parallel = false;
+    };
+
+    /* A copy of the data needed to sort the playlist, so that the sort itself
+     * (which may take a while) can run without holding the playlist lock */
+    struct SortItems
+    {
+        int serial, select_serial;
+        bool selected_only;
+        Index<int> rows;
+        Index<String> filenames;
+        Index<Tuple> tuples;
     };
 
     PlaylistData(Playlist::ID * m_id, const char * title);
@@ -55,6 +73,7 @@ public:
 
     PlaylistEntry * entry_at(int i);
     const PlaylistEntry * entry_at(int i) const;
+    static int entry_number(const PlaylistEntry * entry);
 
     String entry_filename(int i) const;
     PluginHandle * entry_decoder(int i, String * error = nullptr) const;
@@ -82,6 +101,17 @@ public:
     void sort(const CompareData & data);
     void sort_selected(const CompareData & data);
 
+    /* sort() and sort_selected() in three steps; only the first and last
+     * need the playlist lock.  apply_sort() does nothing and returns false if
+     * entries have been added, removed or moved (or, when sorting only the
+     * selected entries, selected or deselected) since get_sort_items().
+     * Metadata changes in between are ignored. */
+    void get_sort_items(const CompareData & data, bool selected_only,
+                        SortItems & items) const;
+    static Index<int> sort_items(const SortItems & items,
+                                 const CompareData & data);
+    bool apply_sort(const SortItems & items, const Index<int> & order);
+
     void reverse_order();
     void randomize_order();
     void reverse_selected();
@@ -102,6 +132,7 @@ public:
 
     bool prev_song(bool repeat);
     bool next_song(bool repeat);
+    int predict_next_song(bool repeat);
     bool prev_album(bool repeat);
     bool next_album(bool repeat);
 
@@ -147,19 +178,24 @@ private:
     typedef SmartPtr<PlaylistEntry, delete_entry> EntryPtr;
 
     void number_entries(int at, int length);
+
+    void insert_rows(int at, int number);
+    void remove_rows(int at, int number);
+    void swap_rows(int a, int b);
+    void move_row(int from, int to);
+    void reorder_rows(int at, const Index<int> & order);
+
     void set_entry_tuple(PlaylistEntry * entry, Tuple && tuple);
     void queue_update(Playlist::UpdateLevel level, int at, int count,
                       int flags = 0);
     void queue_position_change();
 
-    static void sort_entries(Index<EntryPtr> & entries,
-                             const CompareData & data);
-
     int shuffle_pos_before(int ref_pos) const;
     PosChange shuffle_pos_after(int ref_pos, bool by_album) const;
     PosChange shuffle_pos_random(bool repeat, bool by_album) const;
 
     int pos_before(int ref_pos, bool shuffle, bool repeat) const;
+    PosChange next_random_pos(bool repeat, bool & repeated) const;
     PosChange pos_after(int ref_pos, bool shuffle, bool by_album) const;
     PosChange pos_new(bool repeat, bool shuffle, bool by_album,
                       int hint_pos) const;
@@ -181,7 +217,25 @@ public:
 private:
     Playlist::ID * m_id;
     Index<EntryPtr> m_entries;
+
+    /* Frequently used fields are stored in columns parallel to m_entries
+     * rather than in each PlaylistEntry, so that selection, queue and shuffle
+     * operations on large playlists are linear scans of contiguous memory.
+     * All of them must be kept in the same order as m_entries. */
+    Index<int> m_lengths;      // in milliseconds, never negative
+    Index<int> m_shuffle_nums; // order played in shuffle mode (0 = not yet)
+    Index<bool> m_selected;
+    Index<bool> m_in_queue;
+
+    /* built from m_selected; queried from const functions */
+    mutable SelectionTree m_selection_tree;
+
+    int m_serial;        /* changed when entries are added, removed or moved */
+    int m_select_serial; /* changed when entries are selected or deselected */
+
     PlaylistEntry *m_position, *m_focus;
+    PlaylistEntry * m_next_random; /* shuffle pick made by predict_next_song() */
+    bool m_next_random_repeated;   /* the pick starts a new round of repeat */
     int m_selected_count;
     int m_last_shuffle_num;
     Index<PlaylistEntry *> m_queued;
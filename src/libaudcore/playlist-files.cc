@@ -67,7 +67,7 @@ bool playlist_load(const char * filename, String & title,
             if (!pp)
                 continue;
 
-            VFSFile file(filename, "r");
+            VFSFile file(filename, "rm");
             if (!file)
             {
                 aud_ui_show_error(str_printf(_("Error opening %s:\n%s"),
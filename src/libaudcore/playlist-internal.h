@@ -48,7 +48,21 @@ public:
     void set_modified(bool modified) const;
 
     bool insert_flat_playlist(const char * filename) const;
-    void insert_flat_items(int at, Index<PlaylistAddItem> && items) const;
+    /* returns the row at which the items were inserted; if <follow> is set
+     * and the last call to insert_flat_items() was for the same playlist,
+     * <at> is ignored and the items are inserted after the ones inserted
+     * then */
+    int insert_flat_items(int at, Index<PlaylistAddItem> && items,
+                          bool follow = false) const;
+
+    /* like sort_by_tuple() or sort_selected_by_tuple(), but faster; <field>
+     * must be the one compared by <compare> */
+    void sort_by_field(TupleCompareFunc compare, Tuple::Field field,
+                       bool selected_only) const;
+
+    /* like sort_by_filename() or sort_selected_by_filename(), but <compare>
+     * may be called from several threads at once */
+    void sort_by_path(StringCompareFunc compare, bool selected_only) const;
 };
 
 /* playlist.cc */
@@ -62,6 +76,8 @@ void playlist_save_state();
 
 DecodeInfo playback_entry_read(int serial);
 void playback_entry_set_tuple(int serial, Tuple && tuple);
+void playback_entry_prefetch_next(int serial);
+void playback_entry_preload_next(int serial);
 
 /* playlist-cache.cc */
 void playlist_cache_load(Index<PlaylistAddItem> & items);
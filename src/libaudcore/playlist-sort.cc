@@ -0,0 +1,257 @@
+/*
+ * playlist-sort.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "playlist-data.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "internal.h"
+
+/* fewer items than this are not worth starting a thread for */
+#define MIN_ITEMS_PER_THREAD 8192
+#define MAX_THREADS 16
+
+/*
+ * Sorting by a tuple field calls Tuple::get_str() and str_compare() for every
+ * comparison, which is slow for large playlists.  Instead, a key is built once
+ * for each entry, such that comparing two keys byte-wise gives the same order
+ * as the comparison function.  The first 8 bytes of each key are stored
+ * inline, so that most comparisons do not touch the rest of the key.
+ */
+struct SortKey
+{
+    uint64_t prefix;   // first 8 bytes, big-endian, zero-padded
+    const char * rest; // remaining bytes
+    int length;        // total length in bytes
+    int item;          // index into SortItems
+
+    bool operator<(const SortKey & b) const
+    {
+        if (prefix != b.prefix)
+            return prefix < b.prefix;
+
+        int n = aud::min(length, b.length) - 8;
+        int diff = (n > 0) ? memcmp(rest, b.rest, n) : 0;
+
+        return diff ? diff < 0 : length < b.length;
+    }
+};
+
+static int thread_count(int items)
+{
+    int cores = aud::max((int)std::thread::hardware_concurrency(), 1);
+    return aud::clamp(items / MIN_ITEMS_PER_THREAD, 1,
+                      aud::min(cores, MAX_THREADS));
+}
+
+/* calls func(0) through func(n_tasks - 1) in parallel */
+template<class F>
+static void run_parallel(int n_tasks, F func)
+{
+    std::thread threads[MAX_THREADS];
+
+    for (int i = 1; i < n_tasks; i++)
+        threads[i] = std::thread(func, i);
+
+    func(0);
+
+    for (int i = 1; i < n_tasks; i++)
+        threads[i].join();
+}
+
+/* stable merge sort: each thread sorts one chunk, then the chunks are merged
+ * pairwise, with the merges of each round running in parallel */
+template<class T, class Less>
+static void parallel_sort(Index<T> & items, Less less)
+{
+    int n_items = items.len();
+    int n_chunks = thread_count(n_items);
+
+    int bounds[MAX_THREADS + 1];
+    for (int i = 0; i <= n_chunks; i++)
+        bounds[i] = (int64_t)n_items * i / n_chunks;
+
+    T * src = items.begin();
+
+    run_parallel(n_chunks, [&](int chunk) {
+        std::stable_sort(src + bounds[chunk], src + bounds[chunk + 1], less);
+    });
+
+    if (n_chunks < 2)
+        return;
+
+    Index<T> temp;
+    temp.insert(0, n_items);
+    T * dest = temp.begin();
+
+    for (int width = 1; width < n_chunks; width *= 2)
+    {
+        int n_merges = (n_chunks + 2 * width - 1) / (2 * width);
+
+        run_parallel(n_merges, [&](int merge) {
+            int first = 2 * width * merge;
+            int lo = bounds[first];
+            int mid = bounds[aud::min(first + width, n_chunks)];
+            int hi = bounds[aud::min(first + 2 * width, n_chunks)];
+
+            std::merge(src + lo, src + mid, src + mid, src + hi, dest + lo,
+                       less);
+        });
+
+        std::swap(src, dest);
+    }
+
+    if (src != items.begin())
+        memcpy(items.begin(), src, sizeof(T) * n_items);
+}
+
+static void append_int_key(Index<char> & buf, int64_t val)
+{
+    /* flip the sign bit so that negative values sort first */
+    uint64_t bits = (uint64_t)val ^ ((uint64_t)1 << 63);
+
+    for (int shift = 56; shift >= 0; shift -= 8)
+        buf.append((char)(bits >> shift));
+}
+
+/* mirrors tuple_compare_string() and tuple_compare_int() in
+ * playlist-utils.cc; empty fields sort first */
+static void append_key(Index<char> & buf, const Tuple & tuple,
+                       Tuple::Field field)
+{
+    if (Tuple::field_get_type(field) == Tuple::String)
+    {
+        String str = tuple.get_str(field);
+        buf.append((char)(str ? 1 : 0));
+
+        if (str)
+            str_append_collate_key(buf, str);
+    }
+    else
+    {
+        auto type = tuple.get_value_type(field);
+        bool valid = (type == Tuple::Int || type == Tuple::DateTime);
+        buf.append((char)(valid ? 1 : 0));
+
+        if (valid)
+            append_int_key(buf, tuple.get_int64(field));
+    }
+}
+
+/* Builds the keys in parallel; each thread appends to its own buffer, so the
+ * key pointers can only be filled in once all the buffers are complete. */
+static void build_keys(const Index<Tuple> & tuples, Tuple::Field field,
+                       Index<SortKey> & keys, Index<char> (&bufs)[MAX_THREADS])
+{
+    int n_items = tuples.len();
+    int n_chunks = thread_count(n_items);
+
+    keys.insert(0, n_items);
+
+    run_parallel(n_chunks, [&](int chunk) {
+        Index<char> & buf = bufs[chunk];
+        int start = (int64_t)n_items * chunk / n_chunks;
+        int end = (int64_t)n_items * (chunk + 1) / n_chunks;
+
+        Index<int> offsets;
+        offsets.insert(0, end - start);
+
+        for (int i = start; i < end; i++)
+        {
+            offsets[i - start] = buf.len();
+            append_key(buf, tuples[i], field);
+            keys[i].length = buf.len() - offsets[i - start];
+            keys[i].item = i;
+        }
+
+        for (int i = start; i < end; i++)
+        {
+            const char * key = buf.begin() + offsets[i - start];
+            int length = keys[i].length;
+
+            uint64_t prefix = 0;
+            for (int b = 0; b < 8; b++)
+            {
+                unsigned char byte = (b < length) ? key[b] : 0;
+                prefix = (prefix << 8) | byte;
+            }
+
+            keys[i].prefix = prefix;
+            keys[i].rest = key + 8;
+        }
+    });
+}
+
+Index<int> PlaylistData::sort_items(const SortItems & items,
+                                    const CompareData & data) // static
+{
+    Index<int> order;
+
+    if (data.filename_compare)
+    {
+        order.insert(0, items.filenames.len());
+        for (int i = 0; i < order.len(); i++)
+            order[i] = i;
+
+        auto less = [&items, &data](int a, int b) {
+            return data.filename_compare(items.filenames[a],
+                                         items.filenames[b]) < 0;
+        };
+
+        if (data.parallel)
+            parallel_sort(order, less);
+        else
+            std::stable_sort(order.begin(), order.end(), less);
+    }
+    else if (data.key_field != Tuple::Invalid)
+    {
+        Index<SortKey> keys;
+        Index<char> bufs[MAX_THREADS];
+
+        build_keys(items.tuples, data.key_field, keys, bufs);
+        parallel_sort(keys, [](const SortKey & a, const SortKey & b) {
+            return a < b;
+        });
+
+        order.insert(0, keys.len());
+        for (int i = 0; i < order.len(); i++)
+            order[i] = keys[i].item;
+    }
+    else
+    {
+        order.insert(0, items.tuples.len());
+        for (int i = 0; i < order.len(); i++)
+            order[i] = i;
+
+        auto less = [&items, &data](int a, int b) {
+            return data.tuple_compare(items.tuples[a], items.tuples[b]) < 0;
+        };
+
+        if (data.parallel)
+            parallel_sort(order, less);
+        else
+            std::stable_sort(order.begin(), order.end(), less);
+    }
+
+    return order;
+}
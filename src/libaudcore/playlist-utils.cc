@@ -71,7 +71,7 @@ static int tuple_compare_int(const Tuple & a, const Tuple & b,
                              Tuple::Field field)
 {
     auto at = a.get_value_type(field);
-    auto bt = a.get_value_type(field);
+    auto bt = b.get_value_type(field);
 
     if (at != Tuple::Int && at != Tuple::DateTime)
         return (bt != Tuple::Int && bt != Tuple::DateTime) ? 0 : -1;
@@ -190,24 +190,48 @@ static const Playlist::TupleCompareFunc tuple_comparisons[] = {
     tuple_compare_modified,
     tuple_compare_bitrate};
 
+/* the field compared by each of tuple_comparisons */
+static const Tuple::Field tuple_compare_fields[] = {
+    Tuple::Invalid, // path
+    Tuple::Invalid, // filename
+    Tuple::Title,
+    Tuple::Album,
+    Tuple::Artist,
+    Tuple::AlbumArtist,
+    Tuple::Year,
+    Tuple::Genre,
+    Tuple::Track,
+    Tuple::FormattedTitle,
+    Tuple::Length,
+    Tuple::Comment,
+    Tuple::Publisher,
+    Tuple::CatalogNum,
+    Tuple::Disc,
+    Tuple::FileCreated,
+    Tuple::FileModified,
+    Tuple::Bitrate};
+
 static_assert(aud::n_elems(filename_comparisons) == Playlist::n_sort_types &&
-                  aud::n_elems(tuple_comparisons) == Playlist::n_sort_types,
+                  aud::n_elems(tuple_comparisons) == Playlist::n_sort_types &&
+                  aud::n_elems(tuple_compare_fields) == Playlist::n_sort_types,
               "Update playlist comparison functions");
 
 EXPORT void Playlist::sort_entries(SortType scheme) const
 {
     if (filename_comparisons[scheme])
-        sort_by_filename(filename_comparisons[scheme]);
+        PlaylistEx(*this).sort_by_path(filename_comparisons[scheme], false);
     else if (tuple_comparisons[scheme])
-        sort_by_tuple(tuple_comparisons[scheme]);
+        PlaylistEx(*this).sort_by_field(tuple_comparisons[scheme],
+                                        tuple_compare_fields[scheme], false);
 }
 
 EXPORT void Playlist::sort_selected(SortType scheme) const
 {
     if (filename_comparisons[scheme])
-        sort_selected_by_filename(filename_comparisons[scheme]);
+        PlaylistEx(*this).sort_by_path(filename_comparisons[scheme], true);
     else if (tuple_comparisons[scheme])
-        sort_selected_by_tuple(tuple_comparisons[scheme]);
+        PlaylistEx(*this).sort_by_field(tuple_comparisons[scheme],
+                                        tuple_compare_fields[scheme], true);
 }
 
 /* FIXME: this considers empty fields as duplicates */
@@ -223,7 +247,7 @@ EXPORT void Playlist::remove_duplicates(SortType scheme) const
     {
         StringCompareFunc compare = filename_comparisons[scheme];
 
-        sort_by_filename(compare);
+        PlaylistEx(*this).sort_by_path(compare, false);
         String last = entry_filename(0);
 
         for (int i = 1; i < entries; i++)
@@ -240,7 +264,8 @@ EXPORT void Playlist::remove_duplicates(SortType scheme) const
     {
         TupleCompareFunc compare = tuple_comparisons[scheme];
 
-        sort_by_tuple(compare);
+        PlaylistEx(*this).sort_by_field(compare, tuple_compare_fields[scheme],
+                                        false);
         Tuple last = entry_tuple(0);
 
         for (int i = 1; i < entries; i++)
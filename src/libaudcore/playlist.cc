@@ -64,6 +64,9 @@ enum class UpdateState
 
 #define STATE_FILE "playlist-state"
 
+/* number of times to retry sorting without the lock */
+#define SORT_ATTEMPTS 3
+
 #define ENTER_GET_PLAYLIST(...)                                                \
     auto mh = mutex.take();                                                    \
     PlaylistData * playlist = m_id ? m_id->data : nullptr;                     \
@@ -114,6 +117,7 @@ static int resume_playlist = -1;
 static bool resume_paused = false;
 
 static QueuedFunc queued_update;
+static HookId update_hook, position_hook;
 static Playlist::UpdateLevel update_level;
 static int update_hooks;
 static UpdateState update_state;
@@ -138,6 +142,34 @@ static bool scan_enabled_nominal, scan_enabled;
 static int scan_playlist, scan_row;
 static List<ScanItem> scan_list;
 
+/* The entry expected to play next is scanned shortly before the end of the
+ * current one, leaving its file open, so that playback can move on to it
+ * without waiting for any I/O. */
+struct Preload
+{
+    PlaylistData * playlist = nullptr;
+    PlaylistEntry * entry = nullptr;
+    ScanRequest * request = nullptr; // while running
+    bool ready = false;
+
+    DecodeInfo dec;
+    Index<char> image_data;
+    String image_file;
+};
+
+static Preload preload;
+
+/* the last entry inserted by PlaylistEx::insert_flat_items(), so that the next
+ * chunk of a large add can follow it even if the playlist has been edited */
+struct LastInsert
+{
+    Playlist::ID * playlist;
+    PlaylistEntry * entry;
+    int row; /* if entry has been deleted, the row where it was */
+};
+
+static LastInsert last_insert;
+
 static void scan_finish(ScanRequest * request);
 static void scan_cancel(PlaylistEntry * entry);
 static void scan_restart();
@@ -194,10 +226,10 @@ EXPORT void Playlist::process_pending_update()
     mh.unlock();
 
     if (level != Playlist::NoUpdate)
-        hook_call("playlist update", aud::to_ptr(level));
+        hook_call(update_hook, aud::to_ptr(level));
 
     for (PlaylistEx playlist : position_change_list)
-        hook_call("playlist position", aud::to_ptr(playlist));
+        hook_call(position_hook, aud::to_ptr(playlist));
 
     if ((hooks & SetActive))
         hook_call("playlist activate", nullptr);
@@ -371,17 +403,18 @@ static bool scan_queue_next_entry()
 
 static void scan_schedule()
 {
+    int max_scheduled = scanner_max_requests();
     int scheduled = 0;
 
     for (ScanItem * item = scan_list.head(); item; item = scan_list.next(item))
     {
-        if (++scheduled >= SCAN_THREADS)
+        if (++scheduled >= max_scheduled)
             return;
     }
 
     while (scan_queue_next_entry())
     {
-        if (++scheduled >= SCAN_THREADS)
+        if (++scheduled >= max_scheduled)
             return;
     }
 }
@@ -428,6 +461,36 @@ static void scan_cancel(PlaylistEntry * entry)
     delete (item);
 }
 
+static void preload_cancel()
+{
+    preload = Preload();
+    condvar.notify_all();
+}
+
+// called from a scanner thread
+static void preload_finish(ScanRequest * request)
+{
+    auto mh = mutex.take();
+
+    // canceled?
+    if (request != preload.request)
+        return;
+
+    preload.playlist->update_entry_from_scan(preload.entry, request, 0);
+
+    preload.request = nullptr;
+    preload.ready = true;
+
+    preload.dec.filename = request->filename;
+    preload.dec.ip = request->ip;
+    preload.dec.file = std::move(request->file);
+    preload.dec.error = std::move(request->error);
+    preload.image_data = std::move(request->image_data);
+    preload.image_file = std::move(request->image_file);
+
+    condvar.notify_all();
+}
+
 static void scan_restart()
 {
     scan_playlist = 0;
@@ -477,20 +540,39 @@ static void start_playback_locked(int seek_time, bool pause)
     auto entry = playlist->entry_at(playlist->position());
 
     // playback always begins with a rescan of the current entry in order to
-    // open the file, ensure a valid tuple, and read album art
+    // open the file, ensure a valid tuple, and read album art (unless this
+    // has already been done by preloading it)
     scan_cancel(entry);
-    scan_queue_entry(playlist, entry, true);
+
+    if (entry != preload.entry)
+    {
+        preload_cancel();
+        scan_queue_entry(playlist, entry, true);
+    }
 }
 
 static void stop_playback_locked()
 {
     art_clear_current();
     scan_reset_playback();
+    preload_cancel();
 
     playback_stop();
 }
 
-void pl_signal_entry_deleted(PlaylistEntry * entry) { scan_cancel(entry); }
+void pl_signal_entry_deleted(PlaylistEntry * entry)
+{
+    scan_cancel(entry);
+
+    if (entry == preload.entry)
+        preload_cancel();
+
+    if (entry == last_insert.entry)
+    {
+        last_insert.entry = nullptr;
+        last_insert.row = PlaylistData::entry_number(entry);
+    }
+}
 
 void pl_signal_position_changed(Playlist::ID * id)
 {
@@ -578,6 +660,9 @@ void playlist_init()
 
     mh.unlock();
 
+    update_hook = hook_find("playlist update");
+    position_hook = hook_find("playlist position");
+
     hook_associate("set generic_title_format", pl_hook_reformat_titles,
                    nullptr);
     hook_associate("set leading_zero", pl_hook_reformat_titles, nullptr);
@@ -627,10 +712,12 @@ void playlist_end()
     /* playback should already be stopped */
     assert(!playing_id);
     assert(!scan_list.head());
+    assert(!preload.entry);
 
     queued_update.stop();
 
     active_id = nullptr;
+    last_insert = LastInsert();
     resume_playlist = -1;
     resume_paused = false;
 
@@ -709,21 +796,64 @@ EXPORT void Playlist::remove_selected() const
     SIMPLE_VOID_WRAPPER(remove_selected);
 }
 
+/* Sorting a large playlist can take a while, so the sort itself is done
+ * without holding the lock.  If the playlist is changed in the meantime, the
+ * result is thrown away and the sort is tried again, the last time with the
+ * lock held throughout. */
+static void sort_playlist(Playlist::ID * id,
+                          const PlaylistData::CompareData & data,
+                          bool selected_only)
+{
+    auto mh = mutex.take();
+
+    for (int attempt = 0; attempt < SORT_ATTEMPTS; attempt++)
+    {
+        PlaylistData * playlist = id ? id->data : nullptr;
+        if (!playlist)
+            return;
+
+        PlaylistData::SortItems items;
+        playlist->get_sort_items(data, selected_only, items);
+
+        mh.unlock();
+        Index<int> order = PlaylistData::sort_items(items, data);
+        mh.lock();
+
+        /* the playlist may have been deleted */
+        playlist = id->data;
+        if (!playlist || playlist->apply_sort(items, order))
+        {
+            /* release the copied strings and tuples without the lock */
+            mh.unlock();
+            return;
+        }
+    }
+
+    PlaylistData * playlist = id ? id->data : nullptr;
+    if (!playlist)
+        return;
+
+    if (selected_only)
+        playlist->sort_selected(data);
+    else
+        playlist->sort(data);
+}
+
 EXPORT void Playlist::sort_by_filename(StringCompareFunc compare) const
 {
-    SIMPLE_VOID_WRAPPER(sort, {compare, nullptr});
+    sort_playlist(m_id, {compare, nullptr}, false);
 }
 EXPORT void Playlist::sort_by_tuple(TupleCompareFunc compare) const
 {
-    SIMPLE_VOID_WRAPPER(sort, {nullptr, compare});
+    sort_playlist(m_id, {nullptr, compare}, false);
 }
 EXPORT void Playlist::sort_selected_by_filename(StringCompareFunc compare) const
 {
-    SIMPLE_VOID_WRAPPER(sort_selected, {compare, nullptr});
+    sort_playlist(m_id, {compare, nullptr}, true);
 }
 EXPORT void Playlist::sort_selected_by_tuple(TupleCompareFunc compare) const
 {
-    SIMPLE_VOID_WRAPPER(sort_selected, {nullptr, compare});
+    sort_playlist(m_id, {nullptr, compare}, true);
 }
 EXPORT void Playlist::reverse_order() const
 {
@@ -795,10 +925,45 @@ EXPORT Playlist::Update Playlist::update_detail() const
     SIMPLE_WRAPPER(Update, Update(), last_update);
 }
 
-void PlaylistEx::insert_flat_items(int at,
-                                   Index<PlaylistAddItem> && items) const
+int PlaylistEx::insert_flat_items(int at, Index<PlaylistAddItem> && items,
+                                  bool follow) const
 {
-    SIMPLE_VOID_WRAPPER(insert_items, at, std::move(items));
+    ENTER_GET_PLAYLIST(-1);
+
+    int n_entries = playlist->n_entries();
+    int n_items = items.len();
+
+    if (follow && m_id == last_insert.playlist)
+    {
+        if (last_insert.entry)
+            at = PlaylistData::entry_number(last_insert.entry) + 1;
+        else
+            at = last_insert.row; /* deleted; insert where it was */
+    }
+
+    if (at < 0 || at > n_entries)
+        at = n_entries;
+
+    playlist->insert_items(at, std::move(items));
+
+    last_insert.playlist = m_id;
+    last_insert.entry = playlist->entry_at(at + n_items - 1);
+    last_insert.row = at + n_items;
+
+    return at;
+}
+
+void PlaylistEx::sort_by_field(TupleCompareFunc compare, Tuple::Field field,
+                               bool selected_only) const
+{
+    sort_playlist(m_id, {nullptr, compare, field, true}, selected_only);
+}
+
+void PlaylistEx::sort_by_path(StringCompareFunc compare,
+                              bool selected_only) const
+{
+    sort_playlist(m_id, {compare, nullptr, Tuple::Invalid, true},
+                  selected_only);
 }
 
 EXPORT int Playlist::index() const
@@ -1106,6 +1271,9 @@ EXPORT Tuple Playlist::entry_tuple(int entry_num, GetMode mode,
 
 EXPORT void Playlist::rescan_file(const char * filename)
 {
+    scan_cache_invalidate(filename);
+    art_invalidate(filename);
+
     auto mh = mutex.take();
 
     for (auto & playlist : playlists)
@@ -1123,6 +1291,28 @@ DecodeInfo playback_entry_read(int serial)
         auto playlist = playing_id->data;
         auto entry = playlist->entry_at(playlist->position());
 
+        if (entry == preload.entry)
+        {
+            // wait for the preload to finish (or be canceled)
+            while (entry == preload.entry && !preload.ready)
+                condvar.wait(mh);
+
+            if (entry == preload.entry && playback_check_serial(serial))
+            {
+                int pos = playlist->position();
+                playback_set_info(pos, playlist->entry_tuple(pos));
+
+                art_cache_current(preload.dec.filename,
+                                  std::move(preload.image_data),
+                                  std::move(preload.image_file));
+
+                dec = std::move(preload.dec);
+                preload = Preload();
+            }
+
+            return dec;
+        }
+
         ScanItem * item = scan_list_find_entry(entry);
         assert(item && item->for_playback);
 
@@ -1164,6 +1354,59 @@ void playback_entry_set_tuple(int serial, Tuple && tuple)
         playing_id->data->update_playback_entry(std::move(tuple));
 }
 
+// called from playback thread, shortly before the end of a song
+void playback_entry_prefetch_next(int serial)
+{
+    auto mh = mutex.take();
+
+    if (!playback_check_serial(serial) ||
+        aud_get_bool("no_playlist_advance") ||
+        aud_get_bool("stop_after_current_song"))
+        return;
+
+    auto playlist = playing_id->data;
+    int pos = playlist->predict_next_song(aud_get_bool("repeat"));
+    if (pos < 0)
+        return;
+
+    // for a cuesheet entry, prefetch the source file
+    String filename = playlist->entry_tuple(pos).get_str(Tuple::AudioFile);
+    if (!filename)
+        filename = playlist->entry_filename(pos);
+
+    mh.unlock();
+    vfs_prefetch(filename);
+}
+
+// called from playback thread, shortly before the end of a song
+void playback_entry_preload_next(int serial)
+{
+    auto mh = mutex.take();
+
+    if (!playback_check_serial(serial) ||
+        aud_get_bool("no_playlist_advance") ||
+        aud_get_bool("stop_after_current_song"))
+        return;
+
+    auto playlist = playing_id->data;
+    auto entry =
+        playlist->entry_at(playlist->predict_next_song(aud_get_bool("repeat")));
+
+    // don't preload the current entry (i.e. single-song repeat)
+    if (!entry || entry == preload.entry ||
+        entry == playlist->entry_at(playlist->position()))
+        return;
+
+    preload_cancel();
+
+    preload.playlist = playlist;
+    preload.entry = entry;
+    preload.request = playlist->create_scan_request(entry, preload_finish,
+                                                    SCAN_IMAGE | SCAN_FILE);
+
+    scanner_request(preload.request);
+}
+
 void playlist_save_state()
 {
     /* get playback state before locking playlists */
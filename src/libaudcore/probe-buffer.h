@@ -55,6 +55,7 @@ public:
     String get_metadata(const char * field);
 
     void set_limit_to_buffer(bool limit) { m_limited = limit; }
+    VFSImpl * file() { return m_file.get(); }
 
 private:
     void increase_buffer(int64_t size);
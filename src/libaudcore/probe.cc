@@ -57,6 +57,101 @@ InputPlugin * load_input_plugin(PluginHandle * decoder, String * error)
     return ip;
 }
 
+/* Well-known file signatures, used to choose which plugins to try first when
+ * probing by content.  A match only changes the order in which plugins are
+ * tried; the plugin itself still decides whether it can read the file. */
+struct FileMagic
+{
+    int offset;
+    const char * magic;
+    const char * mime[3];
+};
+
+static const char * const mpeg_mime[3] = {"audio/mpeg"};
+
+static const FileMagic file_magics[] = {
+    {0, "fLaC", {"audio/flac", "audio/x-flac"}},
+    {0, "OggS", {"application/ogg", "audio/ogg", "audio/x-vorbis+ogg"}},
+    {0, "ID3", {"audio/mpeg"}},
+    {8, "WAVE", {"audio/wav", "audio/x-wav"}},
+    {8, "AIFF", {"audio/aiff", "audio/x-aiff"}},
+    {8, "AIFC", {"audio/aiff", "audio/x-aiff"}},
+    {4, "ftyp", {"audio/mp4", "audio/x-m4a"}},
+    {0, "MAC ", {"audio/x-ape", "audio/ape"}},
+    {0, "wvpk", {"audio/x-wavpack"}},
+    {0, "MPCK", {"audio/x-musepack"}},
+    {0, "MP+", {"audio/x-musepack"}},
+    {0, "MThd", {"audio/midi", "audio/x-midi"}},
+    {0, "\x30\x26\xb2\x75", {"audio/x-ms-wma", "video/x-ms-asf"}},
+    {0, ".snd", {"audio/basic"}}};
+
+/* longest offset + magic in the table above */
+#define MAGIC_HEADER_SIZE 12
+
+static const char * const * sniff_mime_types(const unsigned char * header,
+                                             int len)
+{
+    for (auto & type : file_magics)
+    {
+        int magic_len = strlen(type.magic);
+        if (len >= type.offset + magic_len &&
+            !memcmp(header + type.offset, type.magic, magic_len))
+            return type.mime;
+    }
+
+    /* MPEG audio frame sync without an ID3 tag */
+    if (len >= 2 && header[0] == 0xff && (header[1] & 0xe0) == 0xe0)
+        return mpeg_mime;
+
+    return nullptr;
+}
+
+static bool plugin_has_mime(PluginHandle * plugin, const char * const * mime)
+{
+    for (int i = 0; i < 3 && mime[i]; i++)
+    {
+        if (input_plugin_has_key(plugin, InputKey::MIME, mime[i]))
+            return true;
+    }
+
+    return false;
+}
+
+/* moves plugins that claim the file's signature to the front of the list */
+static Index<PluginHandle *> order_by_magic(const Index<PluginHandle *> & list,
+                                           VFSFile & file)
+{
+    Index<PluginHandle *> ordered;
+    unsigned char header[MAGIC_HEADER_SIZE];
+
+    int len = file.fread(header, 1, sizeof header);
+    if (file.fseek(0, VFS_SEEK_SET) != 0)
+        return ordered;
+
+    const char * const * mime = sniff_mime_types(header, aud::max(len, 0));
+    if (!mime)
+        return ordered;
+
+    for (PluginHandle * plugin : list)
+    {
+        if (plugin_has_mime(plugin, mime))
+            ordered.append(plugin);
+    }
+
+    if (!ordered.len())
+        return ordered;
+
+    AUDDBG("Matched %d plugins by file signature.\n", ordered.len());
+
+    for (PluginHandle * plugin : list)
+    {
+        if (!plugin_has_mime(plugin, mime))
+            ordered.append(plugin);
+    }
+
+    return ordered;
+}
+
 /* figure out some basic info without opening the file */
 int probe_by_filename(const char * filename)
 {
@@ -120,6 +215,14 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
 
     AUDDBG("Matched %d plugins by extension.\n", ext_matches.len());
 
+    /* result of a previous content probe? */
+    PluginHandle * cached = scan_cache_lookup_decoder(filename);
+    if (cached)
+    {
+        AUDINFO("Matched %s from scan cache.\n", aud_plugin_get_name(cached));
+        return cached;
+    }
+
     if (fast && !ext_matches.len())
         return nullptr;
 
@@ -154,9 +257,13 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
 
     file.set_limit_to_buffer(true);
 
-    for (PluginHandle * plugin : (mime_matches.len()  ? mime_matches
-                                  : ext_matches.len() ? ext_matches
-                                                      : list))
+    auto & candidates = (mime_matches.len()  ? mime_matches
+                         : ext_matches.len() ? ext_matches
+                                             : list);
+
+    Index<PluginHandle *> ordered = order_by_magic(candidates, file);
+
+    for (PluginHandle * plugin : (ordered.len() ? ordered : candidates))
     {
         if (!aud_plugin_get_enabled(plugin))
             continue;
@@ -171,6 +278,7 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
         {
             AUDINFO("Matched %s by content.\n", aud_plugin_get_name(plugin));
             file.set_limit_to_buffer(false);
+            scan_cache_store_decoder(filename, plugin);
             return plugin;
         }
 
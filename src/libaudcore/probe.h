@@ -20,6 +20,8 @@
 #ifndef LIBAUDCORE_PROBE_H
 #define LIBAUDCORE_PROBE_H
 
+#include <stdint.h>
+
 #include <libaudcore/index.h>
 #include <libaudcore/objects.h>
 
@@ -76,6 +78,23 @@ public:
 AudArtPtr aud_art_request(const char * file, int format,
                           bool * queued = nullptr);
 
+/* Like the above, but if <size> is given (in pixels) and only AUD_ART_DATA is
+ * requested, a thumbnail previously stored by aud_art_store_thumbnail() is
+ * returned if there is one; otherwise the full-size image is returned.
+ * Thumbnails of local files are kept on disk and discarded when the song file
+ * is modified. */
+AudArtPtr aud_art_request(const char * file, int format, bool * queued,
+                          int size);
+
+/* Returns the size of thumbnail that aud_art_request() would look for given
+ * <size>, or zero if <size> is too large for thumbnails to be cached. */
+int aud_art_thumbnail_size(int size);
+
+/* Stores a thumbnail (JPEG or PNG data) of the album art for <file>, scaled to
+ * fit within the square returned by aud_art_thumbnail_size(). */
+void aud_art_store_thumbnail(const char * file, int size, const void * data,
+                             int64_t len);
+
 /* ====== GENERAL PROBING API ====== */
 
 /* The following two functions take an additional VFSFile parameter to allow
@@ -21,9 +21,17 @@
 #include "internal.h"
 
 #include <assert.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 void RingBufBase::get_areas(int pos, int len, Areas & areas)
 {
     assert(pos >= 0 && len >= 0 && pos + len <= m_len);
@@ -196,3 +204,264 @@ EXPORT void RingBufBase::move_out(IndexBase & index, int to, int len)
     void * ptr = index.insert(to, len);
     move_out(ptr, len, nullptr);
 }
+
+#ifndef _WIN32
+static int create_shared_memory(int size)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int fd = memfd_create("audacious-ringbuf", MFD_CLOEXEC);
+#else
+    static std::atomic<int> counter;
+
+    char name[64];
+    snprintf(name, sizeof name, "/audacious-ringbuf-%d-%d", (int)getpid(),
+             counter++);
+
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+        shm_unlink(name);
+#endif
+
+    if (fd >= 0 && ftruncate(fd, size) < 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/* maps the same memory twice in a row */
+static char * map_mirrored(int size)
+{
+    int fd = create_shared_memory(size);
+    if (fd < 0)
+        return nullptr;
+
+    /* reserve the address space for both copies first */
+    void * mem = mmap(nullptr, 2 * (size_t)size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    char * data = (mem != MAP_FAILED) ? (char *)mem : nullptr;
+
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_SHARED | MAP_FIXED;
+
+    if (data && (mmap(data, size, prot, flags, fd, 0) == MAP_FAILED ||
+                 mmap(data + size, size, prot, flags, fd, 0) == MAP_FAILED))
+    {
+        munmap(data, 2 * (size_t)size);
+        data = nullptr;
+    }
+
+    close(fd);
+    return data;
+}
+#endif
+
+EXPORT void SPSCRingBuf::alloc(int size)
+{
+    assert(size >= 0 && size <= INT_MAX / 4);
+
+    destroy();
+
+    if (!size)
+        return;
+
+#ifndef _WIN32
+    int page = sysconf(_SC_PAGESIZE);
+    int mapped_size = (size + page - 1) / page * page;
+
+    if ((m_data = map_mirrored(mapped_size)))
+    {
+        m_size = mapped_size;
+        m_mirrored = true;
+    }
+#endif
+
+    /* fall back to ordinary memory */
+    if (!m_data)
+    {
+        m_data = (char *)malloc(size);
+        if (!m_data)
+            throw std::bad_alloc();
+
+        m_size = size;
+        m_mirrored = false;
+    }
+
+    __sync_add_and_fetch(&misc_bytes_allocated, m_size);
+
+    reset();
+}
+
+EXPORT void SPSCRingBuf::destroy()
+{
+    if (!m_data)
+        return;
+
+    __sync_sub_and_fetch(&misc_bytes_allocated, m_size);
+
+#ifndef _WIN32
+    if (m_mirrored)
+        munmap(m_data, 2 * (size_t)m_size);
+    else
+#endif
+        free(m_data);
+
+    m_data = nullptr;
+    m_size = 0;
+    m_mirrored = false;
+
+    reset();
+}
+
+EXPORT void SPSCRingBuf::reset()
+{
+    m_read.store(0);
+    m_write.store(0);
+    m_interrupted.store(false);
+}
+
+EXPORT void * SPSCRingBuf::write_area(int & len)
+{
+    int write = m_write.load(std::memory_order_relaxed);
+    int read = m_read.load(std::memory_order_acquire);
+    int pos = offset(write);
+
+    len = m_size - distance(read, write);
+    if (!m_mirrored)
+        len = aud::min(len, m_size - pos);
+
+    return m_data + pos;
+}
+
+EXPORT void SPSCRingBuf::commit_write(int len)
+{
+    int write = m_write.load(std::memory_order_relaxed);
+    assert(len >= 0 &&
+           len <= m_size - distance(m_read.load(std::memory_order_acquire),
+                                    write));
+
+    m_write.store(advance(write, len));
+    notify();
+}
+
+EXPORT int SPSCRingBuf::write(const void * data, int len)
+{
+    int written = 0;
+
+    while (written < len)
+    {
+        int avail;
+        void * area = write_area(avail);
+
+        avail = aud::min(avail, len - written);
+        if (!avail)
+            break;
+
+        memcpy(area, (const char *)data + written, avail);
+        commit_write(avail);
+        written += avail;
+    }
+
+    return written;
+}
+
+EXPORT const void * SPSCRingBuf::read_area(int & len)
+{
+    int read = m_read.load(std::memory_order_relaxed);
+    int write = m_write.load(std::memory_order_acquire);
+    int pos = offset(read);
+
+    len = distance(read, write);
+    if (!m_mirrored)
+        len = aud::min(len, m_size - pos);
+
+    return m_data + pos;
+}
+
+EXPORT void SPSCRingBuf::commit_read(int len)
+{
+    int read = m_read.load(std::memory_order_relaxed);
+    assert(len >= 0 &&
+           len <= distance(read, m_write.load(std::memory_order_acquire)));
+
+    m_read.store(advance(read, len));
+    notify();
+}
+
+EXPORT int SPSCRingBuf::read(void * data, int len)
+{
+    int done = 0;
+
+    while (done < len)
+    {
+        int avail;
+        const void * area = read_area(avail);
+
+        avail = aud::min(avail, len - done);
+        if (!avail)
+            break;
+
+        memcpy((char *)data + done, area, avail);
+        commit_read(avail);
+        done += avail;
+    }
+
+    return done;
+}
+
+/* The waiting thread registers itself before checking the buffer state, and
+ * the other thread checks for waiters after updating it.  Since all of these
+ * operations are sequentially consistent, at least one of the threads sees the
+ * other's change, so a wake-up cannot be lost.  Notifying under the mutex
+ * ensures that a waiter which has already checked the state is inside
+ * m_cond.wait() before being woken. */
+template<class Ready>
+bool SPSCRingBuf::wait(Ready ready)
+{
+    if (m_interrupted.load())
+        return false;
+    if (ready())
+        return true;
+
+    auto mh = m_mutex.take();
+
+    m_waiters.fetch_add(1);
+
+    while (!m_interrupted.load() && !ready())
+        m_cond.wait(mh);
+
+    m_waiters.fetch_sub(1);
+
+    return !m_interrupted.load();
+}
+
+void SPSCRingBuf::notify()
+{
+    if (m_waiters.load())
+    {
+        auto mh = m_mutex.take();
+        m_cond.notify_all();
+    }
+}
+
+EXPORT bool SPSCRingBuf::wait_space(int len)
+{
+    assert(len >= 0 && len <= m_size);
+    return wait([this, len]() { return space() >= len; });
+}
+
+EXPORT bool SPSCRingBuf::wait_data(int len)
+{
+    assert(len >= 0 && len <= m_size);
+    return wait([this, len]() { return this->len() >= len; });
+}
+
+EXPORT void SPSCRingBuf::interrupt()
+{
+    m_interrupted.store(true);
+
+    auto mh = m_mutex.take();
+    m_cond.notify_all();
+}
@@ -20,7 +20,10 @@
 #ifndef LIBAUDCORE_RINGBUF_H
 #define LIBAUDCORE_RINGBUF_H
 
+#include <atomic>
+
 #include <libaudcore/index.h>
+#include <libaudcore/threads.h>
 
 /*
  * RingBuf is a lightweight ring buffer class, with the following properties:
@@ -183,4 +186,98 @@ private:
     static constexpr int cooked(int len) { return len / sizeof(T); }
 };
 
+/*
+ * SPSCRingBuf is a byte ring buffer for passing data from exactly one producer
+ * thread to exactly one consumer thread, without a lock:
+ *  - The read and write positions are atomic.  Each is only advanced by its
+ *    own thread, so neither side ever waits on the other unless it has to.
+ *  - A thread that has to wait (for free space or for data) sleeps on a
+ *    condition variable, which the other thread only signals if someone is
+ *    actually waiting.
+ *  - Where supported, the buffer memory is mapped twice in a row, so that the
+ *    areas returned by write_area() and read_area() are always linear, even
+ *    when they wrap around the end of the buffer.  Otherwise, the areas end at
+ *    the end of the buffer and the remainder follows at the beginning.
+ * alloc(), destroy() and reset() are not thread-safe and must only be called
+ * while neither thread is using the buffer.
+ */
+
+class SPSCRingBuf
+{
+public:
+    SPSCRingBuf() = default;
+    ~SPSCRingBuf() { destroy(); }
+
+    SPSCRingBuf(const SPSCRingBuf &) = delete;
+    SPSCRingBuf & operator=(const SPSCRingBuf &) = delete;
+
+    // the size may be rounded up (to a multiple of the page size)
+    void alloc(int size);
+    void destroy();
+    void reset(); // discards all data and clears the interrupt flag
+
+    // allocated size of the buffer
+    int size() const { return m_size; }
+
+    // whether write_area() and read_area() never wrap around
+    bool mirrored() const { return m_mirrored; }
+
+    // number of bytes currently used/free (may be out of date immediately
+    // when called from the other thread)
+    int len() const
+    {
+        return distance(m_read.load(), m_write.load());
+    }
+    int space() const { return m_size - len(); }
+
+    // producer: get the free area (len is set to its length), fill some of it,
+    // and then commit the number of bytes written
+    void * write_area(int & len);
+    void commit_write(int len);
+    int write(const void * data, int len); // returns number of bytes written
+
+    // consumer: get the used area, read some of it, and then commit the
+    // number of bytes read
+    const void * read_area(int & len);
+    void commit_read(int len);
+    int read(void * data, int len); // returns number of bytes read
+
+    // block until at least len bytes are free/used; returns false if the
+    // buffer was interrupted instead
+    bool wait_space(int len);
+    bool wait_data(int len);
+
+    // makes any current and future waits return false (until reset)
+    void interrupt();
+
+private:
+    char * m_data = nullptr;
+    int m_size = 0;
+    bool m_mirrored = false;
+
+    // positions range from 0 to 2 * m_size - 1, so that a full buffer can be
+    // told apart from an empty one
+    std::atomic<int> m_read{0}, m_write{0};
+
+    std::atomic<int> m_waiters{0};
+    std::atomic<bool> m_interrupted{false};
+    aud::mutex m_mutex;
+    aud::condvar m_cond;
+
+    int distance(int from, int to) const
+    {
+        return (to >= from) ? to - from : to + 2 * m_size - from;
+    }
+    int offset(int pos) const { return (pos < m_size) ? pos : pos - m_size; }
+    int advance(int pos, int len) const
+    {
+        pos += len;
+        return (pos < 2 * m_size) ? pos : pos - 2 * m_size;
+    }
+
+    template<class Ready>
+    bool wait(Ready ready);
+    void notify();
+};
+
 #endif // LIBAUDCORE_RINGBUF_H
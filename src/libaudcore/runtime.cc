@@ -320,11 +320,13 @@ EXPORT void aud_init()
     eq_init();
     output_init();
     playlist_init();
+    playback_init();
 
     start_plugins_one();
 
     record_init();
     scanner_init();
+    scan_cache_load();
     load_playlists();
 }
 
@@ -332,6 +334,7 @@ static void do_autosave()
 {
     hook_call("config save", nullptr);
     save_playlists(false);
+    scan_cache_save();
     plugin_registry_save();
     config_save();
 }
@@ -366,6 +369,10 @@ EXPORT void aud_cleanup()
 
     adder_cleanup();
     scanner_cleanup();
+    vfs_async_cleanup();
+    vfs_prefetch_cleanup();
+    scan_cache_save();
+    scan_cache_cleanup();
     record_cleanup();
 
     /* In Qt mode, this deletes the QApplication. This must be done
@@ -375,6 +382,7 @@ EXPORT void aud_cleanup()
     stop_plugins_one();
 
     art_cleanup();
+    art_search_cleanup();
     chardet_cleanup();
     eq_cleanup();
     output_cleanup();
@@ -0,0 +1,452 @@
+/*
+ * scan-cache.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "internal.h"
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "inifile.h"
+#include "multihash.h"
+#include "plugins.h"
+#include "runtime.h"
+#include "threads.h"
+#include "tuple.h"
+#include "vfs.h"
+
+/*
+ * The scan cache is a persistent index of the metadata (tuple and decoder)
+ * read by the scanner, keyed by URI.  Each entry records the modification time
+ * and size of the file it was read from, so that the scanner can reuse it
+ * without opening the file as long as neither has changed.  The time is kept in
+ * nanoseconds, since a tag editor may rewrite a file within the same second
+ * without changing its size.  Files whose format had to be determined by
+ * content probing are also indexed without a tuple, so that the probe is not
+ * repeated on every rescan and playback.  Only local files are indexed.  The
+ * index is stored in the user config folder in a simple key=value format
+ * similar to .audpl playlists.
+ */
+
+#define FILENAME "scan-cache"
+
+/* unused entries are dropped once the index grows beyond this size */
+#define MAX_ENTRIES 500000
+
+struct ScanCacheEntry
+{
+    int64_t mtime, size;
+    String decoder; // basename of input plugin
+    Tuple tuple;
+    bool used;
+};
+
+static SimpleHash<String, ScanCacheEntry> cache;
+static aud::mutex mutex;
+static bool loaded, modified;
+
+static bool get_file_stamp(const char * filename, int64_t & mtime,
+                           int64_t & size)
+{
+    if (strncmp(filename, "file://", 7))
+        return false;
+
+    StringBuf path = uri_to_filename(strip_subtune(filename));
+    if (!path)
+        return false;
+
+    return local_file_stamp(path, mtime, size);
+}
+
+static StringBuf get_cache_path()
+{
+    return filename_build({aud_get_path(AudPath::UserDir), FILENAME});
+}
+
+class ScanCacheParser : public IniParser
+{
+public:
+    void finish() { add_current(); }
+
+private:
+    String m_uri;
+    ScanCacheEntry m_entry{-1, -1, String(), Tuple(), false};
+    bool m_has_fields = false;
+
+    void add_current()
+    {
+        if (m_uri && m_entry.mtime >= 0 && m_entry.size >= 0)
+        {
+            /* an entry without any fields stores only the decoder */
+            if (m_has_fields)
+            {
+                m_entry.tuple.set_filename(m_uri);
+                m_entry.tuple.set_state(Tuple::Valid);
+            }
+
+            cache.add(m_uri, std::move(m_entry));
+        }
+
+        m_uri = String();
+        m_entry = {-1, -1, String(), Tuple(), false};
+        m_has_fields = false;
+    }
+
+    void handle_heading(const char *) {}
+
+    void handle_entry(const char * key, const char * value)
+    {
+        if (!strcmp(key, "uri"))
+        {
+            add_current();
+            m_uri = String(value);
+        }
+        else if (!m_uri)
+            return;
+        else if (!strcmp(key, "mtime_ns"))
+            m_entry.mtime = str_to_int64(value);
+        else if (!strcmp(key, "size"))
+            m_entry.size = str_to_int64(value);
+        else if (!strcmp(key, "decoder"))
+            m_entry.decoder = String(value);
+        else
+        {
+            Tuple::Field field = Tuple::field_by_name(key);
+            if (field == Tuple::Invalid)
+                return;
+
+            m_has_fields = true;
+
+            switch (Tuple::field_get_type(field))
+            {
+            case Tuple::String:
+                m_entry.tuple.set_str(field, str_decode_percent(value));
+                break;
+            case Tuple::Int:
+                m_entry.tuple.set_int(field, str_to_int(value));
+                break;
+            case Tuple::DateTime:
+                m_entry.tuple.set_int64(field, str_to_int64(value));
+                break;
+            default:
+                break;
+            }
+        }
+    }
+};
+
+/* fields derived from the URI are not stored */
+static bool field_is_stored(Tuple::Field field)
+{
+    switch (field)
+    {
+    case Tuple::Basename:
+    case Tuple::Path:
+    case Tuple::Suffix:
+    case Tuple::Subtune:
+    case Tuple::FormattedTitle:
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool write_entry(VFSFile & file, const String & uri,
+                        const ScanCacheEntry & entry)
+{
+    if (!inifile_write_entry(file, "uri", uri) ||
+        !inifile_write_entry(file, "mtime_ns", int64_to_str(entry.mtime)) ||
+        !inifile_write_entry(file, "size", int64_to_str(entry.size)))
+        return false;
+
+    if (entry.decoder && !inifile_write_entry(file, "decoder", entry.decoder))
+        return false;
+
+    for (auto field : Tuple::all_fields())
+    {
+        if (!field_is_stored(field))
+            continue;
+
+        const char * key = Tuple::field_get_name(field);
+        bool success = true;
+
+        switch (entry.tuple.get_value_type(field))
+        {
+        case Tuple::String:
+            success = inifile_write_entry(
+                file, key, str_encode_percent(entry.tuple.get_str(field)));
+            break;
+        case Tuple::Int:
+            success = inifile_write_entry(file, key,
+                                          int_to_str(entry.tuple.get_int(field)));
+            break;
+        case Tuple::DateTime:
+            success = inifile_write_entry(
+                file, key, int64_to_str(entry.tuple.get_int64(field)));
+            break;
+        default:
+            break;
+        }
+
+        if (!success)
+            return false;
+    }
+
+    return true;
+}
+
+void scan_cache_load()
+{
+    auto mh = mutex.take();
+
+    if (loaded)
+        return;
+
+    loaded = true;
+    modified = false;
+
+    if (!aud_get_bool("metadata_cache"))
+        return;
+
+    StringBuf path = get_cache_path();
+    if (!VFSFile::test_file(path, VFS_EXISTS))
+        return;
+
+    VFSFile file(path, "r");
+    if (!file)
+        return;
+
+    ScanCacheParser parser;
+    parser.parse(file);
+    parser.finish();
+
+    AUDINFO("Loaded %d entries from scan cache.\n", cache.n_items());
+}
+
+void scan_cache_save()
+{
+    auto mh = mutex.take();
+
+    if (!modified)
+        return;
+
+    if (cache.n_items() > MAX_ENTRIES)
+    {
+        Index<String> unused;
+
+        cache.iterate([&](const String & uri, ScanCacheEntry & entry) {
+            if (!entry.used)
+                unused.append(uri);
+        });
+
+        for (const String & uri : unused)
+            cache.remove(uri);
+    }
+
+    /* write to a temporary file first so that an interrupted save does not
+     * leave a truncated index behind */
+    StringBuf path = get_cache_path();
+    StringBuf temp = str_concat({path, ".tmp"});
+    bool success = true;
+
+    {
+        VFSFile file(temp, "w");
+        if (!file)
+            return;
+
+        cache.iterate([&](const String & uri, ScanCacheEntry & entry) {
+            if (success)
+                success = write_entry(file, uri, entry);
+        });
+
+        if (success && file.fflush() < 0)
+            success = false;
+    }
+
+    if (!success || g_rename(temp, path) < 0)
+    {
+        AUDWARN("Error saving scan cache.\n");
+        g_unlink(temp);
+        return;
+    }
+
+    modified = false;
+}
+
+void scan_cache_cleanup()
+{
+    auto mh = mutex.take();
+
+    cache.clear();
+    loaded = false;
+    modified = false;
+}
+
+bool scan_cache_lookup(const char * filename, PluginHandle *& decoder,
+                       Tuple & tuple)
+{
+    String key(filename);
+    auto mh = mutex.take();
+
+    if (!cache.lookup(key))
+        return false;
+
+    /* don't block other scanner threads while waiting on the disk */
+    mh.unlock();
+
+    int64_t mtime, size;
+    if (!get_file_stamp(filename, mtime, size))
+        return false;
+
+    mh.lock();
+
+    ScanCacheEntry * entry = cache.lookup(key);
+    if (!entry)
+        return false;
+
+    if (entry->mtime != mtime || entry->size != size)
+    {
+        /* file changed on disk */
+        cache.remove(key);
+        modified = true;
+        return false;
+    }
+
+    if (!entry->tuple.valid())
+        return false;
+
+    PluginHandle * cached_decoder = nullptr;
+    if (entry->decoder)
+    {
+        cached_decoder = aud_plugin_lookup_basename(entry->decoder);
+        if (!cached_decoder || !aud_plugin_get_enabled(cached_decoder))
+            return false;
+    }
+
+    if (!decoder)
+        decoder = cached_decoder;
+    else if (decoder != cached_decoder)
+        return false;
+
+    tuple = entry->tuple.ref();
+    entry->used = true;
+
+    return true;
+}
+
+void scan_cache_store(const char * filename, PluginHandle * decoder,
+                      const Tuple & tuple)
+{
+    /* tuples with a subtune list are expanded by the adder and are only
+     * useful when reading the file directly */
+    if (!decoder || !tuple.valid() || tuple.get_n_subtunes())
+        return;
+
+    int64_t mtime, size;
+    if (!get_file_stamp(filename, mtime, size))
+        return;
+
+    auto mh = mutex.take();
+
+    if (!loaded || !aud_get_bool("metadata_cache"))
+        return;
+
+    cache.add(String(filename), {mtime, size,
+                                 String(aud_plugin_get_basename(decoder)),
+                                 tuple.ref(), true});
+    modified = true;
+}
+
+PluginHandle * scan_cache_lookup_decoder(const char * filename)
+{
+    String key(filename);
+    auto mh = mutex.take();
+
+    if (!cache.lookup(key))
+        return nullptr;
+
+    mh.unlock();
+
+    int64_t mtime, size;
+    if (!get_file_stamp(filename, mtime, size))
+        return nullptr;
+
+    mh.lock();
+
+    ScanCacheEntry * entry = cache.lookup(key);
+    if (!entry || !entry->decoder)
+        return nullptr;
+
+    if (entry->mtime != mtime || entry->size != size)
+    {
+        cache.remove(key);
+        modified = true;
+        return nullptr;
+    }
+
+    PluginHandle * decoder = aud_plugin_lookup_basename(entry->decoder);
+    if (!decoder || !aud_plugin_get_enabled(decoder))
+        return nullptr;
+
+    entry->used = true;
+    return decoder;
+}
+
+void scan_cache_store_decoder(const char * filename, PluginHandle * decoder)
+{
+    int64_t mtime, size;
+    if (!get_file_stamp(filename, mtime, size))
+        return;
+
+    auto mh = mutex.take();
+
+    if (!loaded || !aud_get_bool("metadata_cache"))
+        return;
+
+    String key(filename);
+    String basename(aud_plugin_get_basename(decoder));
+    ScanCacheEntry * entry = cache.lookup(key);
+
+    /* keep the tuple if there is one for the same file */
+    if (entry && entry->mtime == mtime && entry->size == size)
+    {
+        if (entry->decoder == basename)
+            return;
+
+        entry->decoder = std::move(basename);
+        entry->used = true;
+    }
+    else
+        cache.add(key, {mtime, size, std::move(basename), Tuple(), true});
+
+    modified = true;
+}
+
+void scan_cache_invalidate(const char * filename)
+{
+    auto mh = mutex.take();
+
+    String key(filename);
+    if (cache.lookup(key))
+    {
+        cache.remove(key);
+        modified = true;
+    }
+}
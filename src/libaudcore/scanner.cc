@@ -19,17 +19,118 @@
 
 #include "scanner.h"
 
+#include <time.h>
+
+#include <chrono>
+
 #include <glib.h> /* for GThreadPool */
 
 #include "cue-cache.h"
+#include "hook.h"
 #include "internal.h"
 #include "plugins.h"
 #include "probe.h"
+#include "runtime.h"
+#include "threads.h"
 #include "tuple.h"
 #include "vfs.h"
 
+/* minimum number of threads when the limit is chosen automatically */
+#define SCAN_THREADS_MIN 2
+
 static GThreadPool * pool;
 
+/*
+ * The number of scanner threads is chosen automatically unless set by the
+ * user.  Each request records its wall-clock time and the CPU time consumed
+ * by the scanning thread.  The difference is time spent waiting on I/O (disk
+ * seeks, network mounts, etc.), during which additional requests can be run
+ * without competing for the CPU.  The limit follows the usual rule of thumb:
+ *
+ *   threads = cores * (1 + wait_time / cpu_time)
+ *
+ * so that CPU-bound tag parsing runs one thread per core, while I/O-bound
+ * scans keep more requests in flight.  Only opening, probing and reading the
+ * file is timed, not the callback.
+ *
+ * Opening files and parsing tags are not run in separate pools, because input
+ * plugins parse tags while they read them through the VFSFile; there is no
+ * point at which all the I/O for a file has been done.  A single pool sized by
+ * the measured ratio covers both cases.
+ */
+static aud::mutex stats_mutex;
+static int n_cores;
+static int thread_limit;
+static double avg_wall_time, avg_cpu_time; // in microseconds
+
+static int64_t get_thread_cpu_time()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    return -1;
+}
+
+static int64_t get_wall_time()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+/* stats_mutex must be held */
+static void update_thread_limit()
+{
+    int limit = aud_get_int("scan_threads");
+
+    if (limit <= 0)
+    {
+        double ratio = 0;
+        if (avg_cpu_time > 0)
+            ratio = aud::max(avg_wall_time - avg_cpu_time, 0.0) / avg_cpu_time;
+
+        limit = aud::max((int)(n_cores * (1 + ratio) + 0.5), SCAN_THREADS_MIN);
+    }
+
+    limit = aud::min(limit, SCAN_THREADS_MAX);
+
+    if (limit != thread_limit)
+    {
+        AUDDBG("Scanner thread limit: %d\n", limit);
+        thread_limit = limit;
+        g_thread_pool_set_max_threads(pool, limit, nullptr);
+    }
+}
+
+static void update_stats(int64_t wall_time, int64_t cpu_time)
+{
+    if (wall_time < 0 || cpu_time < 0)
+        return;
+
+    auto mh = stats_mutex.take();
+
+    /* exponential moving average over roughly the last 16 requests */
+    if (avg_wall_time > 0)
+    {
+        avg_wall_time += (wall_time - avg_wall_time) / 16;
+        avg_cpu_time += (cpu_time - avg_cpu_time) / 16;
+    }
+    else
+    {
+        avg_wall_time = wall_time;
+        avg_cpu_time = cpu_time;
+    }
+
+    update_thread_limit();
+}
+
+static void scan_threads_changed(void *, void *)
+{
+    auto mh = stats_mutex.take();
+    update_thread_limit();
+}
+
 ScanRequest::ScanRequest(const String & filename, int flags, Callback callback,
                          PluginHandle * decoder, Tuple && tuple)
     : filename(filename), flags(flags), callback(callback), decoder(decoder),
@@ -57,7 +158,7 @@ void ScanRequest::read_cuesheet_entry()
     }
 }
 
-void ScanRequest::run()
+void ScanRequest::read()
 {
     /* load cuesheet entry (possibly cached) */
     if (cue_cache)
@@ -71,6 +172,18 @@ void ScanRequest::run()
     bool need_tuple = (flags & SCAN_TUPLE) && !tuple.valid();
     bool need_image = (flags & SCAN_IMAGE);
 
+    /* try the persistent index first (not for cuesheet entries, which are
+     * read from the cuesheet instead) */
+    if (need_tuple && !cue_cache)
+    {
+        Tuple cached;
+        if (scan_cache_lookup(filename, decoder, cached))
+        {
+            tuple = std::move(cached);
+            need_tuple = false;
+        }
+    }
+
     if (!decoder)
         decoder = aud_file_find_decoder(audio_file, false, file, &error);
     if (!decoder)
@@ -89,6 +202,9 @@ void ScanRequest::run()
                                &error))
             goto err;
 
+        if (need_tuple && !cue_cache)
+            scan_cache_store(filename, decoder, tuple);
+
         if (need_image && !image_data.len())
             image_file = art_search(audio_file);
     }
@@ -102,20 +218,47 @@ void ScanRequest::run()
         /* close file if not needed or if an error occurred */
         file = VFSFile();
     }
+}
 
+void ScanRequest::run()
+{
+    read();
     callback(this);
 }
 
 static void scan_worker(void * data, void *)
 {
-    ((ScanRequest *)data)->run();
-    delete (ScanRequest *)data;
+    auto request = (ScanRequest *)data;
+
+    int64_t wall_start = get_wall_time();
+    int64_t cpu_start = get_thread_cpu_time();
+
+    request->read();
+
+    /* the callback is not timed, since waiting for the playlist lock there
+     * would be counted as I/O wait and raise the limit further */
+    int64_t cpu_end = get_thread_cpu_time();
+    if (cpu_start >= 0 && cpu_end >= 0)
+        update_stats(get_wall_time() - wall_start, cpu_end - cpu_start);
+
+    request->callback(request);
+    delete request;
 }
 
 void scanner_init()
 {
-    pool =
-        g_thread_pool_new(scan_worker, nullptr, SCAN_THREADS, false, nullptr);
+    n_cores = aud::max((int)std::thread::hardware_concurrency(), 1);
+    thread_limit = 0;
+    avg_wall_time = avg_cpu_time = 0;
+
+    pool = g_thread_pool_new(scan_worker, nullptr, SCAN_THREADS_MIN, false,
+                             nullptr);
+
+    auto mh = stats_mutex.take();
+    update_thread_limit();
+    mh.unlock();
+
+    hook_associate("set scan_threads", scan_threads_changed, nullptr);
 }
 
 void scanner_request(ScanRequest * request)
@@ -123,4 +266,14 @@ void scanner_request(ScanRequest * request)
     g_thread_pool_push(pool, request, nullptr);
 }
 
-void scanner_cleanup() { g_thread_pool_free(pool, false, true); }
+int scanner_max_requests()
+{
+    auto mh = stats_mutex.take();
+    return thread_limit;
+}
+
+void scanner_cleanup()
+{
+    hook_dissociate("set scan_threads", scan_threads_changed);
+    g_thread_pool_free(pool, false, true);
+}
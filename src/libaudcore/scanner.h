@@ -33,7 +33,8 @@ class PluginHandle;
 #define SCAN_IMAGE (1 << 1)
 #define SCAN_FILE (1 << 2)
 
-#define SCAN_THREADS 2
+/* hard limit on the number of concurrent scanner threads */
+#define SCAN_THREADS_MAX 32
 
 struct ScanRequest
 {
@@ -56,6 +57,8 @@ struct ScanRequest
     ScanRequest(const String & filename, int flags, Callback callback,
                 PluginHandle * decoder = nullptr, Tuple && tuple = Tuple());
 
+    /* read() does the actual work; run() also calls the callback */
+    void read();
     void run();
 
 private:
@@ -66,6 +69,7 @@ private:
 
 void scanner_init();
 void scanner_request(ScanRequest * request);
+int scanner_max_requests();
 void scanner_cleanup();
 
 #endif
@@ -0,0 +1,77 @@
+/*
+ * selection-tree.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "selection-tree.h"
+
+void SelectionTree::fill(int n_rows, bool selected)
+{
+    m_tree.resize(n_rows);
+
+    /* with every flag equal, node i covers exactly lowbit(i + 1) rows */
+    for (int i = 0; i < n_rows; i++)
+        m_tree[i] = selected ? ((i + 1) & -(i + 1)) : 0;
+
+    m_valid = true;
+}
+
+void SelectionTree::set(int row, bool selected)
+{
+    if (!m_valid)
+        return;
+
+    int delta = selected ? 1 : -1;
+    for (int i = row + 1; i <= m_tree.len(); i += (i & -i))
+        m_tree[i - 1] += delta;
+}
+
+void SelectionTree::rebuild(const Index<bool> & flags)
+{
+    int n_rows = flags.len();
+    m_tree.resize(n_rows);
+
+    for (int i = 0; i < n_rows; i++)
+        m_tree[i] = flags[i];
+
+    /* linear-time construction: push each node's count up to its parent */
+    for (int i = 1; i <= n_rows; i++)
+    {
+        int parent = i + (i & -i);
+        if (parent <= n_rows)
+            m_tree[parent - 1] += m_tree[i - 1];
+    }
+
+    m_valid = true;
+}
+
+int SelectionTree::count_before(int row) const
+{
+    int count = 0;
+    for (int i = row; i > 0; i -= (i & -i))
+        count += m_tree[i - 1];
+
+    return count;
+}
+
+int SelectionTree::count(const Index<bool> & flags, int at, int number)
+{
+    if (!m_valid)
+        rebuild(flags);
+
+    return count_before(at + number) - count_before(at);
+}
@@ -0,0 +1,47 @@
+/*
+ * selection-tree.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_SELECTION_TREE_H
+#define LIBAUDCORE_SELECTION_TREE_H
+
+#include "index.h"
+
+/* Fenwick (binary indexed) tree over the selection flags of a playlist, giving
+ * the number of selected entries in any range in O(log n).  Single flag
+ * changes are applied incrementally; after entries are inserted, removed or
+ * reordered, the tree is invalidated and rebuilt on the next query. */
+class SelectionTree
+{
+public:
+    void invalidate() { m_valid = false; }
+    void fill(int n_rows, bool selected);
+    void set(int row, bool selected);
+
+    int count(const Index<bool> & flags, int at, int number);
+
+private:
+    void rebuild(const Index<bool> & flags);
+    int count_before(int row) const;
+
+    /* node i (0-based) counts rows i + 1 - lowbit(i + 1) through i */
+    Index<int> m_tree;
+    bool m_valid = false;
+};
+
+#endif /* LIBAUDCORE_SELECTION_TREE_H */
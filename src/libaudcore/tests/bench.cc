@@ -0,0 +1,305 @@
+/*
+ * bench.cc - Benchmarks for the libaudcore audio path
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/*
+ * Run with "meson test --benchmark" (or directly).  Results are written to
+ * stdout as CSV, one line per benchmark, so that they can be compared between
+ * releases.  An optional argument restricts the run to benchmarks whose name
+ * contains the given string.
+ */
+
+#include "audio.h"
+#include "equalizer-filter.h"
+#include "internal.h"
+#include "ringbuf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+size_t misc_bytes_allocated;
+
+/* a typical output buffer */
+#define FRAMES 4096
+
+/* minimum time to run each benchmark */
+#define MIN_TIME 0.2 // seconds
+
+static const char * filter;
+
+static const char * format_name(int format)
+{
+    static const char * const names[] = {
+        "float",                                    //
+        "s8",      "u8",                            //
+        "s16le",   "s16be",   "u16le",   "u16be",   //
+        "s24le",   "s24be",   "u24le",   "u24be",   //
+        "s32le",   "s32be",   "u32le",   "u32be",   //
+        "s24_3le", "s24_3be", "u24_3le", "u24_3be"};
+
+    return names[format];
+}
+
+static const char * impl_name(AudioImpl impl)
+{
+    static const char * const names[] = {"scalar", "sse2", "avx2", "neon"};
+    return names[(int)impl];
+}
+
+static const char * impl_name(EqFilter::Impl impl)
+{
+    static const char * const names[] = {"scalar", "sse", "avx", "neon"};
+    return names[impl];
+}
+
+/* calls func() repeatedly until MIN_TIME has passed and prints the time taken
+ * per sample */
+template<class F>
+static void run(const char * name, const char * impl, const char * format,
+                int channels, int samples, F func)
+{
+    if (filter && !strstr(name, filter))
+        return;
+
+    using clock = std::chrono::steady_clock;
+
+    func(); /* warm up caches */
+
+    int64_t reps = 0;
+    double elapsed = 0;
+    auto start = clock::now();
+
+    for (int64_t n = 1; elapsed < MIN_TIME; n *= 2)
+    {
+        for (int64_t i = 0; i < n; i++)
+            func();
+
+        reps += n;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+
+    double ns = elapsed * 1e9 / (reps * samples);
+    printf("%s,%s,%s,%d,%d,%.4f,%.2f\n", name, impl, format, channels,
+           samples, ns, 1e3 / ns);
+}
+
+static void bench_conversion()
+{
+    static float floats[AUD_MAX_CHANNELS * FRAMES];
+    static char ints[4 * AUD_MAX_CHANNELS * FRAMES];
+
+    for (int i = 0; i < AUD_MAX_CHANNELS * FRAMES; i++)
+        floats[i] = (float)rand() / RAND_MAX * 2 - 1;
+
+    for (int impl = 0; impl <= (int)AudioImpl::NEON; impl++)
+    {
+        if (!audio_impl_supported((AudioImpl)impl))
+            continue;
+
+        audio_set_impl((AudioImpl)impl);
+
+        for (int format : {FMT_S16_LE, FMT_S16_BE, FMT_S24_LE, FMT_S32_LE,
+                           FMT_S24_3LE})
+        {
+            for (int channels : {2, 6})
+            {
+                int samples = channels * FRAMES;
+
+                run("audio_to_int", impl_name((AudioImpl)impl),
+                    format_name(format), channels, samples, [&]() {
+                        audio_to_int(floats, ints, format, samples);
+                    });
+
+                run("audio_from_int", impl_name((AudioImpl)impl),
+                    format_name(format), channels, samples, [&]() {
+                        audio_from_int(ints, format, floats, samples);
+                    });
+            }
+        }
+    }
+}
+
+static void bench_interlace()
+{
+    static char interlaced[4 * AUD_MAX_CHANNELS * FRAMES];
+    static char planes[AUD_MAX_CHANNELS][4 * FRAMES];
+
+    void * out[AUD_MAX_CHANNELS];
+    const void * in[AUD_MAX_CHANNELS];
+
+    for (int c = 0; c < AUD_MAX_CHANNELS; c++)
+    {
+        out[c] = planes[c];
+        in[c] = planes[c];
+    }
+
+    for (int format : {FMT_FLOAT, FMT_S16_NE, FMT_S24_3NE})
+    {
+        for (int channels : {2, 6})
+        {
+            int samples = channels * FRAMES;
+
+            run("audio_interlace", "", format_name(format), channels, samples,
+                [&]() {
+                    audio_interlace(in, format, channels, interlaced, FRAMES);
+                });
+
+            run("audio_deinterlace", "", format_name(format), channels,
+                samples, [&]() {
+                    audio_deinterlace(interlaced, format, channels, out,
+                                      FRAMES);
+                });
+        }
+    }
+}
+
+/* the conversion stages of output.cc, from the decoder's format through replay
+ * gain, software volume and soft clipping to the output format; "separate"
+ * runs each stage over the whole block, as before the stages were fused */
+static void bench_pipeline()
+{
+    static const StereoVolume volume = {90, 90};
+    static const float gain = 0.9f;
+
+    /* up to a large block, which no longer fits in cache between stages */
+    static const int max_samples = 2 * 16 * FRAMES;
+    static char in[4 * max_samples], out[4 * max_samples];
+    static float floats[max_samples];
+
+    for (int i = 0; i < max_samples; i++)
+        floats[i] = (float)rand() / RAND_MAX * 2 - 1;
+
+    for (int format : {FMT_S16_NE, FMT_S32_NE})
+    {
+        audio_to_int(floats, in, format, max_samples);
+
+        for (int samples : {2 * FRAMES, max_samples})
+        {
+            run("output_pipeline", "separate", format_name(format), 2, samples,
+                [&]() {
+                    audio_from_int(in, format, floats, samples);
+                    audio_amplify(floats, 1, samples, &gain);
+                    audio_amplify(floats, 2, samples / 2, volume);
+                    audio_soft_clip(floats, samples);
+                    audio_to_int(floats, out, format, samples);
+                });
+
+            run("output_pipeline", "fused", format_name(format), 2, samples,
+                [&]() {
+                    audio_convert_input(in, format, floats, samples, gain);
+                    audio_convert_output(floats, out, format, 2, samples,
+                                         &volume, true);
+                });
+        }
+    }
+}
+
+static void bench_equalizer()
+{
+    static const float gains[AUD_EQ_NBANDS] = {6, 3, 0, -3, -6,
+                                               -3, 0, 3, 6, 9};
+
+    static EqFilter eq;
+    static float data[AUD_MAX_CHANNELS * FRAMES];
+
+    for (int impl = EqFilter::Scalar; impl <= EqFilter::NEON; impl++)
+    {
+        if (!EqFilter::impl_supported((EqFilter::Impl)impl))
+            continue;
+
+        for (int channels : {2, 6})
+        {
+            int samples = channels * FRAMES;
+
+            for (int i = 0; i < samples; i++)
+                data[i] = (float)rand() / RAND_MAX * 2 - 1;
+
+            eq.set_impl((EqFilter::Impl)impl);
+            eq.set_format(channels, 44100);
+            eq.set_gains(gains);
+
+            run("eq_filter", impl_name((EqFilter::Impl)impl), "float",
+                channels, samples, [&]() { eq.process(data, samples); });
+        }
+    }
+}
+
+static void bench_fft()
+{
+    static float data[FFT_MAX_SIZE], freq[FFT_MAX_SIZE / 2];
+
+    for (int i = 0; i < FFT_MAX_SIZE; i++)
+        data[i] = (float)rand() / RAND_MAX * 2 - 1;
+
+    for (int size = FFT_MIN_SIZE; size <= FFT_MAX_SIZE; size *= 2)
+    {
+        run("calc_freq", "", "float", 1, size,
+            [&]() { calc_freq(data, freq, size, FFTWindow::Hann); });
+    }
+}
+
+static void bench_ringbuf()
+{
+    static float data[AUD_MAX_CHANNELS * FRAMES];
+
+    for (int channels : {2, 6})
+    {
+        int samples = channels * FRAMES;
+
+        /* not a multiple of the buffer size, so that copies wrap around */
+        RingBuf<float> ring;
+        ring.alloc(samples * 3 + channels * 7);
+
+        run("ringbuf_copy", "", "float", channels, samples, [&]() {
+            ring.copy_in(data, samples);
+            ring.move_out(data, samples);
+        });
+
+        ring.destroy();
+
+        SPSCRingBuf spsc;
+        spsc.alloc(sizeof(float) * (samples * 3 + channels * 7));
+
+        run("spsc_ringbuf_copy", spsc.mirrored() ? "mirrored" : "", "float",
+            channels, samples, [&]() {
+                spsc.write(data, sizeof(float) * samples);
+                spsc.read(data, sizeof(float) * samples);
+            });
+    }
+}
+
+int main(int argc, const char ** argv)
+{
+    if (argc > 1)
+        filter = argv[1];
+
+    printf("benchmark,impl,format,channels,samples,ns_per_sample,"
+           "msamples_per_sec\n");
+
+    bench_conversion();
+    bench_interlace();
+    bench_pipeline();
+    bench_equalizer();
+    bench_fft();
+    bench_ringbuf();
+
+    return 0;
+}
@@ -19,18 +19,24 @@
 
 #include "audio.h"
 #include "audstrings.h"
+#include "equalizer-filter.h"
+#include "hook.h"
 #include "internal.h"
 #include "ringbuf.h"
 #include "runtime.h"
+#include "selection-tree.h"
 #include "tuple-compiler.h"
 #include "tuple.h"
 #include "vfs.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <thread>
+
 static bool use_qt = false;
 
 MainloopType aud_get_mainloop_type()
@@ -70,6 +76,254 @@ static void test_audio_conversion()
         assert(out[i] == (in[i] & 0xffffff));
 }
 
+static void test_audio_simd()
+{
+    static const AudioImpl impls[] = {AudioImpl::SSE2, AudioImpl::AVX2,
+                                      AudioImpl::NEON};
+
+    /* odd length, so that the scalar code handles the last few samples */
+    constexpr int samples = 1003;
+
+    static char ints[4 * samples], ints_out[4 * samples], ints_ref[4 * samples];
+    static float floats[samples], floats_ref[samples];
+    static float in[samples];
+
+    /* include out-of-range values and exact halves (for rounding) */
+    for (int i = 0; i < samples; i++)
+        in[i] = (i % 7) ? (float)rand() / RAND_MAX * 2.5f - 1.25f
+                        : (float)(i - samples / 2) / 256 + 0.5f / 32768;
+
+    for (int i = 0; i < (int)sizeof ints; i++)
+        ints[i] = rand();
+
+    for (AudioImpl impl : impls)
+    {
+        if (!audio_impl_supported(impl))
+            continue;
+
+        for (int format = FMT_S8; format <= FMT_U24_3BE; format++)
+        {
+            int size = FMT_SIZEOF(format) * samples;
+
+            audio_set_impl(AudioImpl::Scalar);
+            audio_from_int(ints, format, floats_ref, samples);
+            audio_to_int(in, ints_ref, format, samples);
+
+            audio_set_impl(impl);
+            audio_from_int(ints, format, floats, samples);
+            assert(!memcmp(floats, floats_ref, sizeof floats));
+
+            audio_to_int(in, ints_out, format, samples);
+            assert(!memcmp(ints_out, ints_ref, size));
+        }
+
+        for (int channels = 1; channels <= AUD_MAX_CHANNELS; channels++)
+        {
+            float factors[AUD_MAX_CHANNELS];
+            for (int c = 0; c < channels; c++)
+                factors[c] = (float)rand() / RAND_MAX * 2;
+
+            int frames = samples / channels;
+
+            memcpy(floats_ref, in, sizeof in);
+            audio_set_impl(AudioImpl::Scalar);
+            audio_amplify(floats_ref, channels, frames, factors);
+
+            memcpy(floats, in, sizeof in);
+            audio_set_impl(impl);
+            audio_amplify(floats, channels, frames, factors);
+
+            assert(!memcmp(floats, floats_ref, sizeof floats));
+        }
+
+        memcpy(floats_ref, in, sizeof in);
+        audio_set_impl(AudioImpl::Scalar);
+        audio_soft_clip(floats_ref, samples);
+
+        memcpy(floats, in, sizeof in);
+        audio_set_impl(impl);
+        audio_soft_clip(floats, samples);
+
+        assert(!memcmp(floats, floats_ref, sizeof floats));
+    }
+}
+
+static void test_audio_pipeline()
+{
+    static const AudioImpl impls[] = {AudioImpl::Scalar, AudioImpl::SSE2,
+                                      AudioImpl::AVX2, AudioImpl::NEON};
+    static const StereoVolume volume = {70, 90};
+    static const float gain = 1.3f;
+
+    /* odd number of frames, so that the scalar code handles the last few */
+    constexpr int frames = 167;
+    constexpr int max_samples = AUD_MAX_CHANNELS * frames;
+
+    static char ints[4 * max_samples], out[4 * max_samples],
+        out_ref[4 * max_samples];
+    static float floats[max_samples], floats_ref[max_samples];
+    static float in[max_samples];
+
+    for (int i = 0; i < (int)sizeof ints; i++)
+        ints[i] = rand();
+    for (int i = 0; i < max_samples; i++)
+        in[i] = (float)rand() / RAND_MAX * 2.5f - 1.25f;
+
+    for (AudioImpl impl : impls)
+    {
+        if (!audio_impl_supported(impl))
+            continue;
+
+        for (int format = FMT_FLOAT; format <= FMT_U24_3BE; format++)
+        {
+            const void * src = (format == FMT_FLOAT) ? (const void *)in : ints;
+
+            for (int channels : {1, 2, 6})
+            {
+                int samples = channels * frames;
+                int size = FMT_SIZEOF(format) * samples;
+
+                /* separate stages, as reference */
+                audio_set_impl(AudioImpl::Scalar);
+
+                if (format == FMT_FLOAT)
+                    memcpy(floats_ref, in, sizeof(float) * samples);
+                else
+                    audio_from_int(ints, format, floats_ref, samples);
+
+                audio_amplify(floats_ref, 1, samples, &gain);
+                audio_amplify(floats_ref, channels, frames, volume);
+                audio_soft_clip(floats_ref, samples);
+
+                if (format != FMT_FLOAT)
+                    audio_to_int(floats_ref, out_ref, format, samples);
+
+                /* fused */
+                audio_set_impl(impl);
+
+                audio_convert_input(src, format, floats, samples, gain);
+                audio_convert_output(floats, out, format, channels, samples,
+                                     &volume, true);
+
+                if (format == FMT_FLOAT)
+                    assert(!memcmp(floats, floats_ref, size));
+                else
+                    assert(!memcmp(out, out_ref, size));
+            }
+        }
+    }
+}
+
+static void test_equalizer_simd()
+{
+    static const float gains[AUD_EQ_NBANDS] = {12, -12, 6, -6, 0,
+                                               3,  -3,  9, -9, 1};
+    static const float gains2[AUD_EQ_NBANDS] = {-6, 6, 0, 12, -12,
+                                                9,  1, -3, 3, -9};
+
+    static EqFilter ref, simd;
+    float in[AUD_MAX_CHANNELS * 256];
+    float out_ref[AUD_MAX_CHANNELS * 256];
+    float out_simd[AUD_MAX_CHANNELS * 256];
+
+    for (int impl = EqFilter::SSE; impl <= EqFilter::NEON; impl++)
+    {
+        if (!EqFilter::impl_supported((EqFilter::Impl)impl))
+            continue;
+
+        for (int rate : {8000, 44100, 192000})
+        {
+            for (int channels = 1; channels <= AUD_MAX_CHANNELS; channels++)
+            {
+                int samples = channels * 256;
+
+                ref.set_impl(EqFilter::Scalar, true);
+                ref.set_format(channels, rate);
+                ref.set_gains(gains);
+
+                /* force the implementation even for 1-2 channels */
+                simd.set_impl((EqFilter::Impl)impl, true);
+                simd.set_format(channels, rate);
+                simd.set_gains(gains);
+
+                /* several blocks, so that filter state is carried over */
+                for (int block = 0; block < 4; block++)
+                {
+                    /* gain change, interpolated over the next block */
+                    if (block == 2)
+                    {
+                        ref.set_gains(gains2, true);
+                        simd.set_gains(gains2, true);
+                    }
+
+                    for (int i = 0; i < samples; i++)
+                        in[i] = (float)rand() / RAND_MAX * 2 - 1;
+
+                    memcpy(out_ref, in, sizeof(float) * samples);
+                    memcpy(out_simd, in, sizeof(float) * samples);
+
+                    ref.process(out_ref, samples);
+                    simd.process(out_simd, samples);
+
+                    /* libaudcore is built with -ffast-math, so the compiler
+                     * may round the two versions differently */
+                    for (int i = 0; i < samples; i++)
+                        assert(fabsf(out_simd[i] - out_ref[i]) <=
+                               1e-3f * (1 + fabsf(out_ref[i])));
+                    assert(!ref.ramping() && !simd.ramping());
+                }
+            }
+        }
+    }
+}
+
+static void test_fft()
+{
+    static float data[FFT_MAX_SIZE], freq[FFT_MAX_SIZE / 2];
+
+    for (int size = FFT_MIN_SIZE; size <= FFT_MAX_SIZE; size *= 2)
+    {
+        /* compare against a direct DFT, without a window */
+        for (int n = 0; n < size; n++)
+            data[n] = (float)rand() / RAND_MAX * 2 - 1;
+
+        calc_freq(data, freq, size, FFTWindow::Rectangular);
+
+        for (int k = 1; k <= size / 2; k += 7)
+        {
+            double re = 0, im = 0;
+            for (int n = 0; n < size; n++)
+            {
+                re += data[n] * cos(2 * M_PI * k * n / size);
+                im -= data[n] * sin(2 * M_PI * k * n / size);
+            }
+
+            double expect = sqrt(re * re + im * im) * ((k < size / 2) ? 2 : 1);
+            assert(fabs(freq[k - 1] - expect / size) < 1e-5);
+        }
+
+        /* a full-scale sine wave peaks at its own frequency, at about 1 */
+        int bin = size / 8;
+        for (int n = 0; n < size; n++)
+            data[n] = sinf(2 * (float)M_PI * bin * n / size);
+
+        for (int w = 0; w < (int)FFTWindow::count; w++)
+        {
+            calc_freq(data, freq, size, (FFTWindow)w);
+
+            int peak = 0;
+            for (int k = 1; k < size / 2; k++)
+            {
+                if (freq[k] > freq[peak])
+                    peak = k;
+            }
+
+            assert(peak == bin - 1);
+            assert(freq[peak] > 0.9f && freq[peak] < 1.1f);
+        }
+    }
+}
+
 static void test_case_conversion()
 {
     const char in[] = "AÄaäEÊeêIÌiìOÕoõUÚuú";
@@ -196,6 +450,38 @@ static void test_filename_split()
     }
 }
 
+static int sign(int x) { return (x > 0) - (x < 0); }
+
+static int compare_collate_keys(const char * a, const char * b)
+{
+    Index<char> key_a, key_b;
+    str_append_collate_key(key_a, a);
+    str_append_collate_key(key_b, b);
+
+    int len = aud::min(key_a.len(), key_b.len());
+    int diff = memcmp(key_a.begin(), key_b.begin(), len);
+
+    return diff ? diff : key_a.len() - key_b.len();
+}
+
+static void test_collate_keys()
+{
+    static const char * const strings[] = {
+        "",         "a",          "A",           "ab",       "aB1",
+        "a1",       "a01",        "a2",          "a10",      "a10b",
+        "a10.",     "a 10",       "a.10",        "10",       "9",
+        "09",       "-1",         "Track 2",     "track 10", "Track 10a",
+        "1a1",      "999999999",  "1000000000",  "2147483647",
+        "z",        "_",          "[1]",         "{1}",
+        "\xc3\xa9", "e\xcc\x81"};
+
+    for (const char * a : strings)
+    {
+        for (const char * b : strings)
+            assert(sign(compare_collate_keys(a, b)) == sign(str_compare(a, b)));
+    }
+}
+
 static void test_tuple_format(const char * format, Tuple & tuple,
                               const char * expected)
 {
@@ -522,6 +808,209 @@ static StringBuf str_repeated_nest(const char * str, int level)
     return buf2;
 }
 
+static void test_spsc_ringbuf()
+{
+    SPSCRingBuf ring;
+    ring.alloc(1000);
+
+    int size = ring.size();
+    assert(size >= 1000);
+    assert(ring.len() == 0);
+    assert(ring.space() == size);
+
+    Index<char> data, out;
+    data.insert(0, size + 100);
+    out.insert(0, size + 100);
+
+    for (int i = 0; i < data.len(); i++)
+        data[i] = (char)(i % 251);
+
+    /* fill completely */
+    assert(ring.write(data.begin(), size + 100) == size);
+    assert(ring.len() == size);
+    assert(ring.space() == 0);
+    assert(ring.read(out.begin(), size - 10) == size - 10);
+    assert(!memcmp(out.begin(), data.begin(), size - 10));
+
+    /* wrap around the end of the buffer */
+    assert(ring.write(data.begin(), 100) == 100);
+
+    int len;
+    const char * area = (const char *)ring.read_area(len);
+    assert(len == (ring.mirrored() ? 110 : 10));
+    assert(!memcmp(area, data.begin() + size - 10, 10));
+
+    if (ring.mirrored())
+        assert(!memcmp(area + 10, data.begin(), 100));
+
+    ring.commit_read(10);
+    assert(ring.read(out.begin(), 200) == 100);
+    assert(!memcmp(out.begin(), data.begin(), 100));
+    assert(ring.len() == 0);
+
+    /* transfer between two threads */
+    const int total = 1000000;
+
+    std::thread producer([&]() {
+        for (int sent = 0; sent < total;)
+        {
+            int chunk = aud::min(1 + sent % 317, total - sent);
+            assert(ring.wait_space(chunk));
+
+            for (int i = 0; i < chunk; i++)
+                data[i] = (char)((sent + i) % 251);
+
+            assert(ring.write(data.begin(), chunk) == chunk);
+            sent += chunk;
+        }
+    });
+
+    for (int received = 0; received < total;)
+    {
+        assert(ring.wait_data(1));
+
+        const char * in = (const char *)ring.read_area(len);
+        for (int i = 0; i < len; i++)
+            assert(in[i] == (char)((received + i) % 251));
+
+        ring.commit_read(len);
+        received += len;
+    }
+
+    producer.join();
+
+    /* interrupt a waiting thread */
+    std::thread consumer([&]() { assert(!ring.wait_data(1)); });
+
+    ring.interrupt();
+    consumer.join();
+
+    assert(!ring.wait_space(1));
+    ring.reset();
+    assert(ring.wait_space(1));
+
+    ring.destroy();
+    assert(ring.size() == 0);
+}
+
+static void test_selection_tree()
+{
+    SelectionTree tree;
+    Index<bool> flags;
+
+    auto linear_count = [&](int at, int number) {
+        int count = 0;
+        for (int row = at; row < at + number; row++)
+            count += flags[row];
+        return count;
+    };
+
+    for (int step = 0; step < 20000; step++)
+    {
+        int n_rows = flags.len();
+        int op = rand() % 100;
+
+        if (op == 0)
+        {
+            /* select all or none */
+            bool selected = rand() % 2;
+            for (bool & flag : flags)
+                flag = selected;
+
+            tree.fill(n_rows, selected);
+        }
+        else if (op < 5)
+        {
+            /* insert or remove rows */
+            int at = rand() % (n_rows + 1);
+            if (rand() % 2)
+            {
+                int number = rand() % 100;
+                flags.insert(at, number);
+                for (int row = at; row < at + number; row++)
+                    flags[row] = rand() % 2;
+            }
+            else
+                flags.remove(at, rand() % (n_rows - at + 1));
+
+            tree.invalidate();
+        }
+        else if (n_rows)
+        {
+            /* toggle one row (ignored by the tree while invalid) */
+            int row = rand() % n_rows;
+            flags[row] = !flags[row];
+            tree.set(row, flags[row]);
+        }
+
+        /* let several changes pile up between queries */
+        if (rand() % 4)
+            continue;
+
+        n_rows = flags.len();
+        int at = rand() % (n_rows + 1);
+        int number = rand() % (n_rows - at + 1);
+
+        assert(tree.count(flags, at, number) == linear_count(at, number));
+        assert(tree.count(flags, 0, n_rows) == linear_count(0, n_rows));
+    }
+}
+
+static void test_hook()
+{
+    static int calls[3];
+    static HookFunction funcs[3];
+
+    funcs[0] = [](void * data, void *) {
+        calls[0] += aud::from_ptr<int>(data);
+    };
+    funcs[1] = [](void * data, void *) {
+        calls[1] += aud::from_ptr<int>(data);
+        /* removed functions are skipped at once, added ones are not called
+         * until the next hook call */
+        hook_dissociate("test hook", funcs[0]);
+        hook_associate("test hook", funcs[2], nullptr);
+    };
+    funcs[2] = [](void * data, void *) {
+        calls[2] += aud::from_ptr<int>(data);
+    };
+
+    HookId hook = hook_find("test hook");
+    assert(hook == hook_find("test hook"));
+    assert(hook != hook_find("other hook"));
+
+    hook_call(hook, aud::to_ptr(1));
+
+    hook_associate("test hook", funcs[1], nullptr);
+    hook_associate("test hook", funcs[0], nullptr);
+    hook_call("test hook", aud::to_ptr(1));
+    assert(calls[0] == 0 && calls[1] == 1 && calls[2] == 0);
+
+    hook_dissociate("test hook", funcs[1]);
+    hook_call(hook, aud::to_ptr(10));
+    assert(calls[0] == 0 && calls[1] == 1 && calls[2] == 10);
+
+    /* call and modify the hook from two threads; funcs[0] may or may not be
+     * called, but funcs[2] must be called every time */
+    std::thread caller([hook]() {
+        for (int i = 0; i < 100000; i++)
+            hook_call(hook, aud::to_ptr(1));
+    });
+
+    for (int i = 0; i < 1000; i++)
+    {
+        hook_associate("test hook", funcs[0], aud::to_ptr(i));
+        hook_dissociate("test hook", funcs[0], aud::to_ptr(i));
+    }
+
+    caller.join();
+    assert(calls[2] == 100010);
+
+    hook_dissociate("test hook", funcs[2]);
+    hook_call(hook, aud::to_ptr(1));
+    assert(calls[2] == 100010);
+}
+
 static void test_stringbuf()
 {
     char expect[262145];
@@ -595,11 +1084,19 @@ int main(int argc, const char ** argv)
         use_qt = true;
 
     test_audio_conversion();
+    test_audio_simd();
+    test_audio_pipeline();
+    test_equalizer_simd();
+    test_fft();
     test_case_conversion();
     test_numeric_conversion();
     test_filename_split();
+    test_collate_keys();
     test_tuple_formats();
     test_ringbuf();
+    test_spsc_ringbuf();
+    test_selection_tree();
+    test_hook();
     test_stringbuf();
     test_str_printf();
     test_uri_construct();
@@ -111,6 +111,25 @@ String write_temp_file(const void * data, int64_t len)
     return String(name);
 }
 
+/* Returns the modification time (in nanoseconds, where the platform provides
+ * them) and the size of a local regular file. */
+bool local_file_stamp(const char * path, int64_t & mtime, int64_t & size)
+{
+    GStatBuf st;
+    if (g_stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    mtime = (int64_t)st.st_mtime * 1000000000;
+#if defined(__APPLE__)
+    mtime += st.st_mtimespec.tv_nsec;
+#elif !defined(_WIN32)
+    mtime += st.st_mtim.tv_nsec;
+#endif
+
+    size = st.st_size;
+    return true;
+}
+
 bool same_basename(const char * a, const char * b)
 {
     const char * dot_a = strrchr(a, '.');
@@ -94,7 +94,13 @@ EXPORT VFSFile::VFSFile(const char * filename, const char * mode)
     if (!tp)
         return;
 
-    VFSImpl * impl = tp->fopen(strip_subtune(filename), mode, m_error);
+    /* only the local transport knows about "m" */
+    StringBuf mode2 = str_copy(mode);
+    char * m = strchr(mode2, 'm');
+    if (m && tp != &local_transport)
+        memmove(m, m + 1, strlen(m));
+
+    VFSImpl * impl = tp->fopen(strip_subtune(filename), mode2, m_error);
     if (!impl)
         return;
 
@@ -281,6 +287,26 @@ EXPORT void VFSFile::set_limit_to_buffer(bool limit)
         AUDERR("<%p> buffering not supported!\n", m_impl.get());
 }
 
+EXPORT const char * VFSFile::view(int64_t & size)
+{
+#ifndef _WIN32
+    VFSImpl * impl = m_impl.get();
+
+    auto buffer = dynamic_cast<ProbeBuffer *>(impl);
+    if (buffer)
+        impl = buffer->file();
+
+    auto mapped = dynamic_cast<MappedFile *>(impl);
+    if (mapped)
+    {
+        size = mapped->size();
+        return mapped->data();
+    }
+#endif
+
+    return nullptr;
+}
+
 EXPORT Index<char> VFSFile::read_all()
 {
     constexpr int maxbuf = 256 * 1024 * 1024;
@@ -290,6 +316,16 @@ EXPORT Index<char> VFSFile::read_all()
     int64_t size = fsize();
     int64_t pos = ftell();
 
+    const char * data = view(size);
+    if (data && pos >= 0 && pos <= size)
+    {
+        buf.insert(data + pos, 0, aud::min(size - pos, (int64_t)maxbuf));
+        if (fseek(pos + buf.len(), VFS_SEEK_SET) < 0)
+            buf.clear();
+
+        return buf;
+    }
+
     if (size >= 0 && pos >= 0 && pos <= size)
     {
         buf.insert(0, aud::min(size - pos, (int64_t)maxbuf));
@@ -392,6 +428,33 @@ EXPORT Index<String> VFSFile::read_folder(const char * filename, String & error)
     return tp ? tp->read_folder(filename, error) : Index<String>();
 }
 
+EXPORT Index<VFSFolderEntry> VFSFile::read_folder(const char * filename,
+                                                  VFSFileTest test,
+                                                  String & error)
+{
+    auto tp = lookup_transport(filename, error);
+    if (!tp)
+        return Index<VFSFolderEntry>();
+
+    if (tp == &local_transport)
+        return local_transport.read_folder(filename, test, error);
+
+    Index<VFSFolderEntry> entries;
+
+    for (String & name : tp->read_folder(filename, error))
+    {
+        String error2;
+        VFSFileTest mode = tp->test_file(name, test, error2);
+
+        if (error2)
+            AUDERR("%s: %s\n", (const char *)name, (const char *)error2);
+
+        entries.append(std::move(name), mode);
+    }
+
+    return entries;
+}
+
 EXPORT Index<char> VFSFile::read_file(const char * filename,
                                       VFSReadOptions options)
 {
@@ -399,7 +462,7 @@ EXPORT Index<char> VFSFile::read_file(const char * filename,
 
     if (!(options & VFS_IGNORE_MISSING) || test_file(filename, VFS_EXISTS))
     {
-        VFSFile file(filename, "r");
+        VFSFile file(filename, "rm");
         if (file)
             text = file.read_all();
         else
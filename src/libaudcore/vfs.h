@@ -43,6 +43,13 @@ enum VFSFileTest
     VFS_NO_ACCESS = (1 << 5)
 };
 
+/* a folder entry, with the results of the requested tests */
+struct VFSFolderEntry
+{
+    String filename;
+    VFSFileTest mode;
+};
+
 enum VFSReadOptions
 {
     VFS_APPEND_NULL = (1 << 0),
@@ -125,6 +132,8 @@ public:
     {
     }
 
+    /* <mode> is as for fopen(); as with glibc, an "m" may be added to a
+     * read-only mode to request that a local file be mapped into memory */
     VFSFile(const char * filename, const char * mode);
 
     /* creates a temporary file (deleted when closed) */
@@ -160,6 +169,11 @@ public:
 
     /* utility functions */
 
+    /* if the file is mapped into memory (see above), returns its contents and
+     * sets <size>, without copying; otherwise, returns nullptr.  The data is
+     * valid until the file is closed. */
+    const char * view(int64_t & size);
+
     /* reads the entire file into memory (limited to 256 MiB) */
     Index<char> read_all();
 
@@ -180,6 +194,11 @@ public:
     /* returns a sorted list of folder entries (as full URIs) */
     static Index<String> read_folder(const char * filename, String & error);
 
+    /* same, but also tests each entry as test_file() would; for local folders
+     * this is done in one pass, without looking up each full path again */
+    static Index<VFSFolderEntry> read_folder(const char * filename,
+                                             VFSFileTest test, String & error);
+
     /* convenience functions to read/write entire files */
     static Index<char> read_file(const char * filename, VFSReadOptions options);
     static bool write_file(const char * filename, const void * data,
@@ -18,65 +18,252 @@
  */
 
 #include "vfs_async.h"
+#include "internal.h"
 #include "list.h"
 #include "mainloop.h"
+#include "multihash.h"
 #include "threads.h"
 #include "vfs.h"
 
-struct QueuedData : public ListNode
+/*
+ * Requests are read by a small pool of worker threads, highest priority
+ * first.  Requests for a file that is already queued (or being read) are
+ * merged with the existing request, so that the file is only read once.
+ * Each caller is given an ID, with which it can cancel its request; a
+ * request is dropped once all of its callers have cancelled it.
+ */
+
+#define MAX_THREADS 4
+
+struct Consumer : public ListNode
 {
-    const String filename;
+    const int id;
     const VFSConsumer cons_f;
 
-    std::thread thread;
+    Consumer(int id, VFSConsumer cons_f) : id(id), cons_f(cons_f) {}
+};
+
+struct Request : public ListNode
+{
+    enum State
+    {
+        Pending,
+        Reading,
+        Finished
+    };
+
+    const String filename;
+    int priority;
+    State state = Pending;
+
+    List<Consumer> consumers;
     Index<char> buf;
 
-    QueuedData(const char * filename, VFSConsumer cons_f)
-        : filename(filename), cons_f(cons_f)
+    Request(const String & filename, int priority)
+        : filename(filename), priority(priority)
     {
     }
+
+    ~Request() { consumers.clear(); }
 };
 
-static QueuedFunc queued_func;
-static List<QueuedData> queue;
 static aud::mutex mutex;
+static aud::condvar condvar;
+static QueuedFunc queued_func;
+
+static List<Request> pending; // ordered by priority, then by age
+static List<Request> finished;
+
+/* all requests, by filename and by consumer ID */
+static SimpleHash<String, Request *> requests;
+static SimpleHash<IntHashKey, Request *> requests_by_id;
+
+static std::thread threads[MAX_THREADS];
+static int n_threads, n_idle;
+static int next_id = 1;
+static bool quit;
+
+/* mutex must be held */
+static void enqueue(Request * request)
+{
+    Request * prev = pending.tail();
+    while (prev && prev->priority < request->priority)
+        prev = pending.prev(prev);
+
+    pending.insert_after(prev, request);
+}
+
+/* mutex must be held */
+static void destroy(Request * request)
+{
+    for (Consumer * consumer = request->consumers.head(); consumer;
+         consumer = request->consumers.next(consumer))
+        requests_by_id.remove(consumer->id);
+
+    requests.remove(request->filename);
+    delete request;
+}
 
 static void send_data()
 {
     auto mh = mutex.take();
 
-    QueuedData * data;
-    while ((data = queue.head()))
+    Request * request;
+    while ((request = finished.head()))
     {
-        queue.remove(data);
+        /* consumers are called one at a time, so that any of them can still
+         * be cancelled by the previous ones */
+        Consumer * consumer = request->consumers.pop_head();
+        if (!consumer)
+        {
+            finished.remove(request);
+            destroy(request);
+            continue;
+        }
+
+        requests_by_id.remove(consumer->id);
 
         mh.unlock();
 
-        data->thread.join();
-        data->cons_f(data->filename, data->buf);
-        delete data;
+        consumer->cons_f(request->filename, request->buf);
+        delete consumer;
 
         mh.lock();
     }
 }
 
-static void read_worker(QueuedData * data)
+static void read_worker()
 {
-    VFSFile file(data->filename, "r");
-    if (file)
-        data->buf = file.read_all();
+    auto mh = mutex.take();
+
+    while (!quit)
+    {
+        Request * request = pending.pop_head();
+        if (!request)
+        {
+            n_idle++;
+            condvar.wait(mh);
+            n_idle--;
+            continue;
+        }
+
+        request->state = Request::Reading;
+
+        mh.unlock();
+
+        VFSFile file(request->filename, "rm");
+        if (file)
+            request->buf = file.read_all();
+
+        mh.lock();
 
+        /* all consumers cancelled while reading? */
+        if (!request->consumers.head())
+        {
+            destroy(request);
+            continue;
+        }
+
+        request->state = Request::Finished;
+
+        if (!finished.head())
+            queued_func.queue(send_data);
+
+        finished.append(request);
+    }
+}
+
+EXPORT int vfs_async_file_get_contents(const char * filename,
+                                       VFSConsumer cons_f, int priority)
+{
     auto mh = mutex.take();
 
-    if (!queue.head())
-        queued_func.queue(send_data);
+    String key(filename);
+    Request * request;
+    Request ** found = requests.lookup(key);
+
+    if (found)
+    {
+        request = *found;
+
+        /* move an earlier request up if needed */
+        if (request->state == Request::Pending && priority > request->priority)
+        {
+            pending.remove(request);
+            request->priority = priority;
+            enqueue(request);
+        }
+    }
+    else
+    {
+        request = new Request(key, priority);
+        requests.add(key, std::move(request));
+        enqueue(request);
+
+        if (n_idle)
+            condvar.notify_one();
+        else if (n_threads < MAX_THREADS)
+            threads[n_threads++] = std::thread(read_worker);
+    }
 
-    queue.append(data);
+    int id = next_id++;
+    request->consumers.append(new Consumer(id, cons_f));
+    requests_by_id.add(id, std::move(request));
+
+    return id;
 }
 
 EXPORT void vfs_async_file_get_contents(const char * filename,
                                         VFSConsumer cons_f)
 {
-    auto data = new QueuedData(filename, cons_f);
-    data->thread = std::thread(read_worker, data);
+    vfs_async_file_get_contents(filename, cons_f, 0);
+}
+
+EXPORT void vfs_async_cancel(int id)
+{
+    auto mh = mutex.take();
+
+    Request ** found = requests_by_id.lookup(id);
+    if (!found)
+        return;
+
+    Request * request = *found;
+    requests_by_id.remove(id);
+
+    Consumer * consumer = request->consumers.find(
+        [id](const Consumer & consumer) { return consumer.id == id; });
+
+    request->consumers.remove(consumer);
+    delete consumer;
+
+    /* a request being read is dropped by the worker thread, a finished one
+     * by send_data() */
+    if (!request->consumers.head() && request->state == Request::Pending)
+    {
+        pending.remove(request);
+        destroy(request);
+    }
+}
+
+void vfs_async_cleanup()
+{
+    auto mh = mutex.take();
+    quit = true;
+    condvar.notify_all();
+    mh.unlock();
+
+    /* waits for any files still being read */
+    for (int i = 0; i < n_threads; i++)
+        threads[i].join();
+
+    mh.lock();
+
+    queued_func.stop();
+
+    Request * request;
+    while ((request = pending.pop_head()) || (request = finished.pop_head()))
+        destroy(request);
+
+    n_threads = 0;
+    quit = false;
 }
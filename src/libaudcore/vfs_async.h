@@ -26,6 +26,12 @@
 typedef std::function<void(const char * filename, const Index<char> & buf)>
     VFSConsumer;
 
+/* Reads a file in the background and passes its contents to cons_f in the
+ * main thread.  Requests with a higher priority are read first.  The returned
+ * ID can be passed to vfs_async_cancel(), after which cons_f is not called. */
+int vfs_async_file_get_contents(const char * filename, VFSConsumer cons_f,
+                                int priority);
 void vfs_async_file_get_contents(const char * filename, VFSConsumer cons_f);
+void vfs_async_cancel(int id);
 
 #endif
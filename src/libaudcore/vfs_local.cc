@@ -21,6 +21,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <fcntl.h>
+#include <thread>
+
 #include <glib/gstdio.h>
 
 /* needs to be after system headers for #undef's to take effect */
@@ -29,7 +32,9 @@
 
 #include "audstrings.h"
 #include "i18n.h"
+#include "internal.h"
 #include "runtime.h"
+#include "threads.h"
 
 #ifdef _WIN32
 #define fseeko fseeko64
@@ -76,6 +81,113 @@ private:
     LocalOp m_last_op;
 };
 
+#ifdef _WIN32
+
+static VFSImpl * map_file(const char *, FILE *) { return nullptr; }
+
+#else
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/* larger files are read the usual way, as with read_all() */
+#define MAX_MAP_SIZE (256 * 1024 * 1024)
+
+/* a file modified this recently may still be growing */
+#define MIN_MAP_AGE 2 /* seconds */
+
+/* Maps a file opened for reading into memory.  Returns nullptr (leaving the
+ * stream open) if the file is not a regular file, is empty, too large, or
+ * recently modified, or if mmap() fails. */
+static VFSImpl * map_file(const char * path, FILE * stream)
+{
+    struct stat st;
+    int fd = fileno(stream);
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        st.st_size > MAX_MAP_SIZE || st.st_mtime > time(nullptr) - MIN_MAP_AGE)
+        return nullptr;
+
+    void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        perror(path);
+        return nullptr;
+    }
+
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    /* the mapping remains valid after the file is closed */
+    if (fclose(stream) < 0)
+        perror(path);
+
+    return new MappedFile(path, (const char *)data, st.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+    if (munmap((void *)m_data, m_size) < 0)
+        perror(m_path);
+}
+
+int64_t MappedFile::fread(void * ptr, int64_t size, int64_t nmemb)
+{
+    if (size <= 0 || nmemb <= 0)
+        return 0;
+
+    int64_t avail = aud::max(m_size - m_pos, (int64_t)0);
+    int64_t bytes = aud::min(size * nmemb, avail);
+
+    /* like stdio, read as much as possible, even if not a whole element */
+    memcpy(ptr, m_data + m_pos, bytes);
+    m_pos += bytes;
+
+    if (bytes < size * nmemb)
+        m_eof = true;
+
+    return bytes / size;
+}
+
+int MappedFile::fseek(int64_t offset, VFSSeekType whence)
+{
+    int64_t pos;
+
+    if (whence == VFS_SEEK_SET)
+        pos = offset;
+    else if (whence == VFS_SEEK_CUR)
+        pos = m_pos + offset;
+    else if (whence == VFS_SEEK_END)
+        pos = m_size + offset;
+    else
+        pos = -1;
+
+    if (pos < 0)
+    {
+        AUDERR("%s: %s\n", (const char *)m_path, strerror(EINVAL));
+        return -1;
+    }
+
+    m_pos = pos;
+    m_eof = false;
+
+    return 0;
+}
+
+int64_t MappedFile::fwrite(const void *, int64_t, int64_t)
+{
+    AUDERR("%s: %s\n", (const char *)m_path, strerror(EBADF));
+    return 0;
+}
+
+int MappedFile::ftruncate(int64_t)
+{
+    AUDERR("%s: %s\n", (const char *)m_path, strerror(EBADF));
+    return -1;
+}
+
+#endif
+
 VFSImpl * LocalTransport::fopen(const char * uri, const char * mode,
                                 String & error)
 {
@@ -99,6 +211,15 @@ VFSImpl * LocalTransport::fopen(const char * uri, const char * mode,
 
     StringBuf mode2 = str_concat({mode, suffix});
 
+    /* "m" is handled here, not by fopen() */
+    bool want_map = false;
+    char * m = strchr(mode2, 'm');
+    if (m)
+    {
+        want_map = (mode[0] == 'r' && !strchr(mode, '+'));
+        memmove(m, m + 1, strlen(m));
+    }
+
     FILE * stream = ::g_fopen(path, mode2);
 
     if (!stream)
@@ -123,9 +244,107 @@ VFSImpl * LocalTransport::fopen(const char * uri, const char * mode,
         }
     }
 
+    if (want_map)
+    {
+        VFSImpl * mapped = map_file(path, stream);
+        if (mapped)
+            return mapped;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* files are mostly read from start to end (for decoding, for example), so
+     * ask for more aggressive read-ahead than stdio buffering provides */
+    if (mode[0] == 'r' && !strchr(mode, '+'))
+        posix_fadvise(fileno(stream), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
     return new LocalFile(path, stream);
 }
 
+/*
+ * Prefetching reads the beginning of a local file (such as the next song in
+ * the playlist) into the page cache ahead of time.  Opening the file may block
+ * for a while on a network mount, so it is done in a separate thread.  Only the
+ * most recent request is kept.
+ */
+
+#ifdef POSIX_FADV_WILLNEED
+
+#define PREFETCH_SIZE (1024 * 1024)
+
+static aud::mutex prefetch_mutex;
+static aud::condvar prefetch_cond;
+static std::thread prefetch_thread;
+static String prefetch_path;
+static bool prefetch_quit;
+
+static void prefetch_worker()
+{
+    auto mh = prefetch_mutex.take();
+
+    while (!prefetch_quit)
+    {
+        if (!prefetch_path)
+        {
+            prefetch_cond.wait(mh);
+            continue;
+        }
+
+        String path = std::move(prefetch_path);
+        mh.unlock();
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0)
+        {
+            posix_fadvise(fd, 0, PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+
+        mh.lock();
+    }
+}
+
+void vfs_prefetch(const char * filename)
+{
+    StringBuf path = uri_to_filename(filename);
+    if (!path)
+        return;
+
+    auto mh = prefetch_mutex.take();
+
+    prefetch_path = String(path);
+
+    if (prefetch_thread.joinable())
+        prefetch_cond.notify_all();
+    else
+    {
+        prefetch_quit = false;
+        prefetch_thread = std::thread(prefetch_worker);
+    }
+}
+
+void vfs_prefetch_cleanup()
+{
+    auto mh = prefetch_mutex.take();
+
+    prefetch_path = String();
+    prefetch_quit = true;
+    prefetch_cond.notify_all();
+
+    if (prefetch_thread.joinable())
+    {
+        mh.unlock();
+        prefetch_thread.join();
+    }
+}
+
+#else
+
+void vfs_prefetch(const char *) {}
+void vfs_prefetch_cleanup() {}
+
+#endif
+
 VFSImpl * StdinTransport::fopen(const char * uri, const char * mode,
                                 String & error)
 {
@@ -321,6 +540,20 @@ ERR:
     return -1;
 }
 
+static int test_mode(unsigned mode)
+{
+    int passed = VFS_EXISTS;
+
+    if (S_ISREG(mode))
+        passed |= VFS_IS_REGULAR;
+    if (S_ISDIR(mode))
+        passed |= VFS_IS_DIR;
+    if (mode & S_IXUSR)
+        passed |= VFS_IS_EXECUTABLE;
+
+    return passed;
+}
+
 VFSFileTest LocalTransport::test_file(const char * uri, VFSFileTest test,
                                       String & error)
 {
@@ -362,14 +595,7 @@ VFSFileTest LocalTransport::test_file(const char * uri, VFSFileTest test,
             goto out;
         }
 
-        if (S_ISREG(st.st_mode))
-            passed |= VFS_IS_REGULAR;
-        if (S_ISDIR(st.st_mode))
-            passed |= VFS_IS_DIR;
-        if (st.st_mode & S_IXUSR)
-            passed |= VFS_IS_EXECUTABLE;
-
-        passed |= VFS_EXISTS;
+        passed |= test_mode(st.st_mode);
     }
 
 out:
@@ -412,6 +638,127 @@ Index<String> LocalTransport::read_folder(const char * uri, String & error)
     return entries;
 }
 
+#ifdef _WIN32
+
+Index<VFSFolderEntry> LocalTransport::read_folder(const char * uri,
+                                                  VFSFileTest test,
+                                                  String & error)
+{
+    Index<VFSFolderEntry> entries;
+
+    for (String & name : read_folder(uri, error))
+    {
+        String error2;
+        VFSFileTest mode = test_file(name, test, error2);
+
+        if (error2)
+            AUDERR("%s: %s\n", (const char *)name, (const char *)error2);
+
+        entries.append(std::move(name), mode);
+    }
+
+    return entries;
+}
+
+#else
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* Same as test_file(), but for a folder entry.  The entry type reported by
+ * readdir() is used where possible; otherwise the entry is looked up relative
+ * to the open folder, rather than by its full path. */
+static int test_entry(int dir_fd, const struct dirent * ent, int test,
+                      const char * path)
+{
+#ifdef DT_UNKNOWN
+    if (!(test & VFS_IS_EXECUTABLE))
+    {
+        if (ent->d_type == DT_DIR)
+            return VFS_IS_DIR | VFS_EXISTS;
+        if (ent->d_type == DT_REG)
+            return VFS_IS_REGULAR | VFS_EXISTS;
+    }
+#endif
+
+    int passed = 0;
+    bool need_stat = true;
+    struct stat st;
+
+    if (test & VFS_IS_SYMLINK)
+    {
+        if (fstatat(dir_fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+            goto ERR;
+
+        if (S_ISLNK(st.st_mode))
+            passed |= VFS_IS_SYMLINK;
+        else
+            need_stat = false;
+    }
+
+    if (test & (VFS_IS_REGULAR | VFS_IS_DIR | VFS_IS_EXECUTABLE | VFS_EXISTS |
+                VFS_NO_ACCESS))
+    {
+        if (need_stat && fstatat(dir_fd, ent->d_name, &st, 0) < 0)
+            goto ERR;
+
+        passed |= test_mode(st.st_mode);
+    }
+
+    return passed;
+
+ERR:
+    AUDERR("%s/%s: %s\n", path, ent->d_name, strerror(errno));
+    return passed | VFS_NO_ACCESS;
+}
+
+Index<VFSFolderEntry> LocalTransport::read_folder(const char * uri,
+                                                  VFSFileTest test,
+                                                  String & error)
+{
+    Index<VFSFolderEntry> entries;
+
+    StringBuf path = uri_to_filename(uri);
+    if (!path)
+    {
+        error = String(_("Invalid file name"));
+        return entries;
+    }
+
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR * folder = (dir_fd >= 0) ? fdopendir(dir_fd) : nullptr;
+
+    if (!folder)
+    {
+        error = String(strerror(errno));
+        if (dir_fd >= 0)
+            close(dir_fd);
+
+        return entries;
+    }
+
+    struct dirent * ent;
+    while ((ent = readdir(folder)))
+    {
+        // skip hidden files (may need revisiting)
+        if (ent->d_name[0] == '.')
+            continue;
+
+        int mode = test_entry(dir_fd, ent, test, path);
+
+        entries.append(
+            String(filename_to_uri(filename_build({path, ent->d_name}))),
+            VFSFileTest(test & mode));
+    }
+
+    closedir(folder);
+
+    return entries;
+}
+
+#endif
+
 #ifdef _WIN32
 #include <sys/stat.h>
 #include <sys/types.h>
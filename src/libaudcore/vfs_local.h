@@ -31,11 +31,49 @@ public:
     VFSFileTest test_file(const char * filename, VFSFileTest test,
                           String & error);
     Index<String> read_folder(const char * filename, String & error);
+    Index<VFSFolderEntry> read_folder(const char * filename, VFSFileTest test,
+                                      String & error);
 
     bool get_file_timestamps(const char * filename, int64_t * mtime,
                              int64_t * birthtime);
 };
 
+#ifndef _WIN32
+/* a read-only local file mapped into memory */
+class MappedFile : public VFSImpl
+{
+public:
+    MappedFile(const char * path, const char * data, int64_t size)
+        : m_path(path), m_data(data), m_size(size)
+    {
+    }
+
+    ~MappedFile();
+
+    const char * data() const { return m_data; }
+    int64_t size() const { return m_size; }
+
+protected:
+    int64_t fread(void * ptr, int64_t size, int64_t nmemb);
+    int fseek(int64_t offset, VFSSeekType whence);
+
+    int64_t ftell() { return m_pos; }
+    int64_t fsize() { return m_size; }
+    bool feof() { return m_eof; }
+
+    int64_t fwrite(const void * ptr, int64_t size, int64_t nmemb);
+    int ftruncate(int64_t length);
+    int fflush() { return 0; }
+
+private:
+    String m_path;
+    const char * m_data;
+    int64_t m_size;
+    int64_t m_pos = 0;
+    bool m_eof = false;
+};
+#endif
+
 class StdinTransport : public TransportPlugin
 {
 public:
@@ -23,42 +23,103 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <atomic>
+#include <thread>
+
+#include "audio.h"
 #include "hook.h"
-#include "list.h"
 #include "mainloop.h"
 #include "output.h"
+#include "runtime.h"
 #include "threads.h"
 
-#define INTERVAL 33 /* milliseconds */
 #define FRAMES_PER_NODE 512
+#define MAX_FPS 240
 
-struct VisNode : public ListNode
-{
-    VisNode(int channels, int time)
-        : channels(channels), time(time),
-          data(new float[channels * FRAMES_PER_NODE])
-    {
-    }
-
-    ~VisNode() { delete[] data; }
+/* The queue must hold a node for every frame of the audio buffered between
+ * vis_runner_pass_audio() and the speakers: the output buffer plus whatever
+ * the output plugin buffers itself, which is allowed for with an extra margin.
+ * The number of nodes is rounded up to a power of 2. */
+#define MIN_NODES 16
+#define PLUGIN_BUFFER_MARGIN 1000 /* milliseconds */
 
-    const int channels;
+/*
+ * The audio thread (vis_runner_pass_audio) fills nodes and the main thread
+ * (send_audio) consumes them, passing through a ring of preallocated nodes, so
+ * that the audio thread never has to wait for the main thread or allocate
+ * memory.  Nodes from read_count to write_count - 1 are queued.  Only the
+ * audio thread advances write_count and only send_audio() advances read_count.
+ *
+ * One node is queued for each frame to be displayed, that is, one for every
+ * <interval> milliseconds of audio.  At high frame rates the nodes overlap, so
+ * the audio thread keeps a history of the most recent audio and copies each
+ * node out of it once all of the node's audio has been passed in.  For FFT
+ * sizes larger than a node, each node also gets a mono copy of the history
+ * leading up to its end.
+ *
+ * Instead of emptying the queue, a flush increments flush_serial.  Nodes
+ * queued before the flush are then skipped by send_audio(), and the audio
+ * thread clears its history the next time it is called.
+ *
+ * The nodes are allocated by the main thread (or whichever thread starts or
+ * stops visualization).  Before they are reallocated, <active> is cleared and
+ * the audio thread is allowed to finish with them (see stop_audio_thread).
+ */
+struct VisNode
+{
+    int channels;
     int time;
-    float * data;
+    int serial;
+    float * data;    /* AUD_MAX_CHANNELS * FRAMES_PER_NODE */
+    float * history; /* history_frames, if used */
 };
 
+static_assert(FRAMES_PER_NODE == FFT_MIN_SIZE, "Update FRAMES_PER_NODE");
+
+static std::atomic<unsigned> read_count, write_count;
+static std::atomic<int> flush_serial;
+static std::atomic<bool> active;     /* enabled and playing */
+static std::atomic<bool> audio_busy; /* audio thread is using the nodes */
+static std::atomic<int> interval;    /* milliseconds between frames */
+static std::atomic<int> overruns;    /* nodes dropped, queue full */
+
+/* changed only while the audio thread is stopped */
+static Index<VisNode> nodes;
+static Index<float> node_data, node_history;
+static unsigned n_nodes;   /* a power of 2 */
+static int history_frames; /* 0 if not needed */
+
+/* used only by the audio thread */
+static float history[AUD_MAX_CHANNELS * FFT_MAX_SIZE];
+static int history_pos, history_len; /* in frames */
+static int history_channels, history_serial = -1;
+
+/* used only by the main thread (and the functions below) */
 static aud::mutex mutex;
 static bool enabled = false;
 static bool playing = false, paused = false;
-static VisNode * current_node = nullptr;
-static int current_frames;
-static List<VisNode> vis_list;
-static List<VisNode> vis_pool;
+static int fps = 0;
 static QueuedFunc queued_clear;
+static QueuedFunc frame_timer;
+static int frame_timer_interval;
+static int fft_size = FFT_MIN_SIZE;
 
-static void send_audio(void *)
+/* copies of the node being sent */
+static float send_data[AUD_MAX_CHANNELS * FRAMES_PER_NODE];
+static float send_history[FFT_MAX_SIZE];
+
+static struct
+{
+    int sent;    /* nodes passed to the visualizers */
+    int late;    /* ... but more than one frame behind the output */
+    int dropped; /* nodes skipped because a newer one was due */
+    int missed;  /* frames with no node ready */
+} stats;
+
+static void send_audio()
 {
     /* call before locking mutex to avoid deadlock */
+    /* this is already compensated for the latency of the output plugin */
     int outputted = output_get_raw_time();
 
     auto mh = mutex.take();
@@ -66,42 +127,77 @@ static void send_audio(void *)
     if (!enabled || !playing || paused)
         return;
 
+    int serial = flush_serial.load();
+    int frame_ms = interval.load();
+    unsigned read = read_count.load(std::memory_order_relaxed);
+    unsigned write = write_count.load(std::memory_order_acquire);
+
     VisNode * node = nullptr;
-    VisNode * next;
 
-    while ((next = vis_list.head()))
+    for (; read != write; read++)
     {
+        VisNode * next = &nodes[read & (n_nodes - 1)];
+
+        /* skip nodes from before a flush */
+        if (next->serial != serial)
+            continue;
+
         /* If we are considering a node, stop searching and use it if it is the
          * most recent (that is, the next one is in the future).  Otherwise,
          * consider the next node if it is not in the future by more than the
-         * length of an interval. */
-        if (next->time > outputted + (node ? 0 : INTERVAL))
+         * length of a frame. */
+        if (next->time > outputted + (node ? 0 : frame_ms))
             break;
 
         if (node)
-            vis_pool.prepend(node);
+            stats.dropped++;
 
         node = next;
-        vis_list.remove(node);
     }
 
     if (!node)
+    {
+        stats.missed++;
+        read_count.store(read, std::memory_order_release);
         return;
+    }
+
+    stats.sent++;
+    if (node->time < outputted - frame_ms)
+        stats.late++;
+
+    /* copy the node before releasing it, so that the audio thread can reuse
+     * it (and the nodes can be reallocated) while the visualizers run */
+    int channels = node->channels;
+    memcpy(send_data, node->data,
+           sizeof(float) * channels * FRAMES_PER_NODE);
+
+    int history_len = history_frames;
+    if (history_len)
+        memcpy(send_history, node->history, sizeof(float) * history_len);
+
+    read_count.store(read, std::memory_order_release);
 
     mh.unlock();
-    vis_send_audio(node->data, node->channels);
-    mh.lock();
+    vis_send_audio(send_data, channels, history_len ? send_history : nullptr,
+                   history_len);
+}
 
-    vis_pool.prepend(node);
+static void report_stats()
+{
+    if (stats.sent || stats.missed)
+        AUDINFO("Visualization: %d frames sent (%d late), %d dropped, "
+                "%d missed, %d lost to a full queue.\n",
+                stats.sent, stats.late, stats.dropped, stats.missed,
+                overruns.load());
+
+    stats = {};
+    overruns.store(0);
 }
 
 static void flush(aud::mutex::holder &)
 {
-    delete current_node;
-    current_node = nullptr;
-
-    vis_list.clear();
-    vis_pool.clear();
+    flush_serial++;
 
     if (enabled)
         queued_clear.queue(vis_send_clear);
@@ -113,6 +209,68 @@ void vis_runner_flush()
     flush(mh);
 }
 
+/* clears <active> and waits for vis_runner_pass_audio() to return, if it is
+ * running; the audio thread does not touch the nodes again until <active> is
+ * set again */
+static void stop_audio_thread()
+{
+    active.store(false);
+
+    while (audio_busy.load())
+        std::this_thread::yield();
+}
+
+static void alloc_nodes(aud::mutex::holder & mh, int count, int history)
+{
+    count = aud::max(count, MIN_NODES);
+
+    unsigned size = MIN_NODES;
+    while (size < (unsigned)count)
+        size *= 2;
+
+    if (size == n_nodes && history == history_frames)
+        return;
+
+    stop_audio_thread();
+    flush(mh);
+
+    n_nodes = size;
+    history_frames = history;
+    read_count.store(0);
+    write_count.store(0);
+
+    nodes.clear();
+    node_data.clear();
+    node_history.clear();
+
+    nodes.insert(0, size);
+    node_data.insert(0, size * AUD_MAX_CHANNELS * FRAMES_PER_NODE);
+    node_history.insert(0, size * history);
+
+    for (unsigned i = 0; i < size; i++)
+    {
+        nodes[i].data = &node_data[i * AUD_MAX_CHANNELS * FRAMES_PER_NODE];
+        nodes[i].history = history ? &node_history[i * history] : nullptr;
+    }
+}
+
+static void free_nodes(aud::mutex::holder &)
+{
+    if (!n_nodes)
+        return;
+
+    stop_audio_thread();
+
+    n_nodes = 0;
+    history_frames = 0;
+    read_count.store(0);
+    write_count.store(0);
+
+    nodes.clear();
+    node_data.clear();
+    node_history.clear();
+}
+
 static void start_stop(aud::mutex::holder & mh, bool new_playing,
                        bool new_paused)
 {
@@ -121,13 +279,41 @@ static void start_stop(aud::mutex::holder & mh, bool new_playing,
 
     queued_clear.stop();
 
-    if (!enabled || !playing)
+    /* a frame rate of zero turns visualization off completely */
+    bool on = enabled && fps > 0;
+
+    if (!on || !playing)
+    {
         flush(mh);
+        report_stats();
+    }
+
+    int frame_ms = (fps > 0) ? (1000 + fps / 2) / fps : 0;
+    interval.store(frame_ms);
+
+    if (on)
+    {
+        int buffer_ms =
+            aud_get_int("output_buffer_size") + PLUGIN_BUFFER_MARGIN;
+        int history = (fft_size > FRAMES_PER_NODE) ? fft_size : 0;
 
-    if (enabled && playing && !paused)
-        timer_add(TimerRate::Hz30, send_audio);
+        alloc_nodes(mh, buffer_ms / frame_ms + 2, history);
+    }
     else
-        timer_remove(TimerRate::Hz30, send_audio);
+        free_nodes(mh);
+
+    active.store(on && playing);
+
+    if (on && playing && !paused)
+    {
+        if (!frame_timer.running() || frame_timer_interval != interval.load())
+        {
+            frame_timer_interval = interval.load();
+            frame_timer.start(frame_timer_interval, send_audio);
+        }
+    }
+    else
+        frame_timer.stop();
 }
 
 void vis_runner_start_stop(bool new_playing, bool new_paused)
@@ -136,82 +322,188 @@ void vis_runner_start_stop(bool new_playing, bool new_paused)
     start_stop(mh, new_playing, new_paused);
 }
 
+static void update_fft_size(void *, void *)
+{
+    int new_size = vis_fft_size();
+
+    auto mh = mutex.take();
+    fft_size = new_size;
+    start_stop(mh, playing, paused);
+}
+
+static void update_fps(void * = nullptr, void * = nullptr)
+{
+    int new_fps = aud::clamp(aud_get_int("vis_fps"), 0, MAX_FPS);
+
+    auto mh = mutex.take();
+    fps = new_fps;
+    start_stop(mh, playing, paused);
+}
+
+/* appends the given frames to the history */
+static void add_history(const float * data, int frames, int channels)
+{
+    /* only the last FFT_MAX_SIZE frames are kept */
+    if (frames > FFT_MAX_SIZE)
+    {
+        data += channels * (frames - FFT_MAX_SIZE);
+        frames = FFT_MAX_SIZE;
+    }
+
+    history_len = aud::min(history_len + frames, FFT_MAX_SIZE);
+
+    while (frames)
+    {
+        int part = aud::min(frames, FFT_MAX_SIZE - history_pos);
+        memcpy(history + channels * history_pos, data,
+               sizeof(float) * channels * part);
+
+        history_pos = (history_pos + part) & (FFT_MAX_SIZE - 1);
+        data += channels * part;
+        frames -= part;
+    }
+}
+
+/* copies <frames> frames ending <back> frames before the end of the history,
+ * optionally downmixed to mono; missing frames are filled with silence */
+static void copy_history(float * to, int frames, int back, int channels,
+                         bool mono)
+{
+    int width = mono ? 1 : channels;
+    int missing = aud::max(frames + back - history_len, 0);
+
+    memset(to, 0, sizeof(float) * width * missing);
+
+    for (int i = missing; i < frames; i++)
+    {
+        int pos = (history_pos - back - frames + i) & (FFT_MAX_SIZE - 1);
+        const float * frame = history + channels * pos;
+
+        if (!mono)
+            memcpy(to + channels * i, frame, sizeof(float) * channels);
+        else if (channels > 1)
+            to[i] = (frame[0] + frame[1]) / 2;
+        else
+            to[i] = frame[0];
+    }
+}
+
+/* called from the audio thread; must not lock or allocate */
 void vis_runner_pass_audio(int time, const Index<float> & data, int channels,
                            int rate)
 {
-    auto mh = mutex.take();
+    if (channels > AUD_MAX_CHANNELS)
+        return;
+
+    /* see stop_audio_thread() */
+    audio_busy.store(true);
 
-    if (!enabled || !playing)
+    if (!active.load())
+    {
+        audio_busy.store(false);
         return;
+    }
 
-    /* We can build a single node from multiple calls; we can also build
-     * multiple nodes from the same call.  If current_node is present, it was
-     * partly built in the last call and needs to be finished. */
+    int serial = flush_serial.load();
+    int frame_ms = interval.load();
 
-    int at = 0;
+    if (serial != history_serial || channels != history_channels)
+    {
+        history_pos = history_len = 0;
+        history_channels = channels;
+        history_serial = serial;
+    }
+
+    int frames = data.len() / channels;
+    int added = 0; /* frames of data added to the history so far */
 
     while (1)
     {
-        if (current_node)
-            assert(current_node->channels == channels);
-        else
+        unsigned write = write_count.load(std::memory_order_relaxed);
+        unsigned read = read_count.load(std::memory_order_acquire);
+
+        /* if the queue is full, drop the node */
+        if (write - read >= n_nodes)
         {
-            int node_time = time;
-
-            /* There is no partly-built node, so start a new one.  Normally
-             * there will be nodes in the queue already; if so, we want to copy
-             * audio data from the signal starting at 30 milliseconds after the
-             * beginning of the most recent node.  If there are no nodes in the
-             * queue, we are at the beginning of the song or had an underrun,
-             * and we want to copy the earliest audio data we have. */
-
-            VisNode * tail = vis_list.tail();
-            if (tail)
-                node_time = tail->time + INTERVAL;
-
-            at = channels * (int)((int64_t)(node_time - time) * rate / 1000);
-
-            if (at < 0)
-                at = 0;
-            if (at >= data.len())
-                break;
-
-            current_node = vis_pool.head();
-
-            if (current_node)
-            {
-                assert(current_node->channels == channels);
-                vis_pool.remove(current_node);
-                current_node->time = node_time;
-            }
-            else
-                current_node = new VisNode(channels, node_time);
-
-            current_frames = 0;
+            overruns++;
+            break;
         }
 
-        /* Copy as much data as we can, limited by how much we have and how much
-         * space is left in the node.  If we cannot fill the node, we return and
-         * wait for more data to be passed in the next call.  If we do fill the
-         * node, we loop and start building a new one. */
+        /* Normally there will be nodes in the queue already; if so, the next
+         * node starts one frame after the beginning of the most recent one.
+         * If there are no nodes in the queue, we are at the beginning of the
+         * song or had an underrun, and we want to start with the earliest
+         * audio data we have (the oldest frame in the history).  The same
+         * goes if the next node would start even earlier (e.g. because nodes
+         * were dropped).  The most recent node is not modified by
+         * send_audio(), so it is safe to read even if send_audio() releases it
+         * meanwhile. */
+
+        VisNode * tail = &nodes[(write - 1) & (n_nodes - 1)];
+        int earliest = added - history_len; /* relative to the start of data */
+        int node_time = 0, start = earliest;
+
+        if (write != read && tail->serial == serial)
+        {
+            node_time = tail->time + frame_ms;
+            start = (int)((int64_t)(node_time - time) * rate / 1000);
+        }
 
-        int copy = aud::min(data.len() - at,
-                            channels * (FRAMES_PER_NODE - current_frames));
-        memcpy(current_node->data + channels * current_frames, &data[at],
-               sizeof(float) * copy);
-        current_frames += copy / channels;
+        if (start <= earliest)
+        {
+            start = earliest;
+            node_time = time + (int)((int64_t)start * 1000 / rate);
+        }
 
-        if (current_frames < FRAMES_PER_NODE)
+        /* wait for more data if the node is not complete yet */
+        int end = start + FRAMES_PER_NODE;
+        if (end > frames)
             break;
 
-        vis_list.append(current_node);
-        current_node = nullptr;
+        if (end > added)
+        {
+            add_history(&data[channels * added], end - added, channels);
+            added = end;
+        }
+
+        VisNode * node = &nodes[write & (n_nodes - 1)];
+        node->channels = channels;
+        node->time = node_time;
+        node->serial = serial;
+
+        copy_history(node->data, FRAMES_PER_NODE, added - end, channels, false);
+        if (history_frames)
+            copy_history(node->history, history_frames, added - end, channels,
+                         true);
+
+        write_count.store(write + 1, std::memory_order_release);
     }
+
+    if (frames > added)
+        add_history(&data[channels * added], frames - added, channels);
+
+    audio_busy.store(false);
 }
 
 void vis_runner_enable(bool enable)
 {
+    if (enable)
+    {
+        hook_associate("set vis_fft_size", update_fft_size, nullptr);
+        hook_associate("set vis_fps", update_fps, nullptr);
+    }
+    else
+    {
+        hook_dissociate("set vis_fft_size", update_fft_size);
+        hook_dissociate("set vis_fps", update_fps);
+    }
+
+    int new_fps = aud::clamp(aud_get_int("vis_fps"), 0, MAX_FPS);
+    int new_fft_size = vis_fft_size();
+
     auto mh = mutex.take();
     enabled = enable;
+    fps = new_fps;
+    fft_size = new_fft_size;
     start_stop(mh, playing, paused);
 }
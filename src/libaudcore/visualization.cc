@@ -65,6 +65,18 @@ void vis_send_clear()
         vis->clear();
 }
 
+/* the configured FFT size, rounded down to a supported one */
+int vis_fft_size()
+{
+    int size = FFT_MIN_SIZE;
+    int config = aud_get_int("vis_fft_size");
+
+    while (size < FFT_MAX_SIZE && size * 2 <= config)
+        size *= 2;
+
+    return size;
+}
+
 static void pcm_to_mono(const float * data, float * mono, int channels)
 {
     if (channels == 1)
@@ -80,7 +92,10 @@ static void pcm_to_mono(const float * data, float * mono, int channels)
     }
 }
 
-void vis_send_audio(const float * data, int channels)
+/* history, if not null, is the mono signal leading up to the end of data, for
+ * FFT sizes larger than 512 */
+void vis_send_audio(const float * data, int channels, const float * history,
+                    int history_frames)
 {
     auto is_active = [](int type_mask) {
         for (Visualizer * vis : visualizers)
@@ -94,11 +109,31 @@ void vis_send_audio(const float * data, int channels)
 
     float mono[512];
     float freq[256];
+    static float freq_hires[FFT_MAX_SIZE / 2];
+
+    bool need_freq = is_active(Visualizer::Freq);
+    bool need_hires = is_active(Visualizer::FreqHiRes);
 
-    if (is_active(Visualizer::MonoPCM | Visualizer::Freq))
+    int window = aud_get_int("vis_fft_window");
+    if (window < 0 || window >= (int)FFTWindow::count)
+        window = (int)FFTWindow::Hamming;
+
+    if (is_active(Visualizer::MonoPCM) || need_freq || (need_hires && !history))
         pcm_to_mono(data, mono, channels);
-    if (is_active(Visualizer::Freq))
-        calc_freq(mono, freq);
+    if (need_freq)
+        calc_freq(mono, freq, FFT_MIN_SIZE, (FFTWindow)window);
+
+    /* the spectrum is computed only once per frame, and shared with the
+     * low-resolution visualizers if the sizes are the same */
+    const float * hires = freq;
+    int hires_size = history ? history_frames : FFT_MIN_SIZE;
+
+    if (need_hires && (history || !need_freq))
+    {
+        calc_freq(history ? history : mono, freq_hires, hires_size,
+                  (FFTWindow)window);
+        hires = freq_hires;
+    }
 
     for (Visualizer * vis : visualizers)
     {
@@ -108,6 +143,8 @@ void vis_send_audio(const float * data, int channels)
             vis->render_multi_pcm(data, channels);
         if ((vis->type_mask & Visualizer::Freq))
             vis->render_freq(freq);
+        if ((vis->type_mask & Visualizer::FreqHiRes))
+            vis->render_freq_hires(hires, hires_size / 2);
     }
 }
 
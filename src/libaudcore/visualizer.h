@@ -29,7 +29,8 @@ public:
     {
         MonoPCM = (1 << 0),
         MultiPCM = (1 << 1),
-        Freq = (1 << 2)
+        Freq = (1 << 2),
+        FreqHiRes = (1 << 3)
     };
 
     const int type_mask;
@@ -47,6 +48,11 @@ public:
     /* intensity of frequencies 1/512, 2/512, ..., 256/512 of sample rate */
     virtual void render_freq(const float * freq) {}
 
+    /* intensity of frequencies 1/N, 2/N, ..., (N/2)/N of sample rate, where N
+     * is the FFT size set in the "vis_fft_size" config option (512 to 4096);
+     * bins = N/2 */
+    virtual void render_freq_hires(const float * freq, int bins) {}
+
     /* common math for rendering a frequency graph (see util.cc) */
     static void compute_log_xscale(float * xscale, int bands);
     static float compute_freq_band(const float * freq, const float * xscale,
@@ -73,7 +73,7 @@ static void do_load_file (const char * filename, const EqualizerPreset *)
     Index<EqualizerPreset> presets;
     presets.append ();
 
-    VFSFile file (filename, "r");
+    VFSFile file (filename, "rm");
     if (! file || ! aud_load_preset_file (presets[0], file))
         return;
 
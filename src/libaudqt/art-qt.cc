@@ -18,6 +18,7 @@
  */
 
 #include <QApplication>
+#include <QBuffer>
 #include <QIcon>
 #include <QImage>
 #include <QPixmap>
@@ -57,10 +58,40 @@ EXPORT QPixmap art_scale(const QImage & image, unsigned int w, unsigned int h,
     return pixmap;
 }
 
+/* Scaling a large cover down takes longer than decoding a small thumbnail, so
+ * the scaled image is handed back to libaudcore to be cached. */
+static QImage thumbnail_request(const char * filename, int size)
+{
+    AudArtPtr art = aud_art_request(filename, AUD_ART_DATA, nullptr, size);
+
+    auto data = art.data();
+    if (!data)
+        return QImage();
+
+    auto img = QImage::fromData((const uchar *)data->begin(), data->len());
+    if (img.isNull() || (img.width() <= size && img.height() <= size))
+        return img;
+
+    img = img.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+
+    if (img.save(&buffer, "PNG"))
+        aud_art_store_thumbnail(filename, size, png.constData(), png.size());
+
+    return img;
+}
+
 EXPORT QPixmap art_request(const char * filename, unsigned int w,
                            unsigned int h, bool want_hidpi)
 {
-    auto img = art_request(filename);
+    qreal r = want_hidpi ? qApp->devicePixelRatio() : 1;
+    int thumb = aud_art_thumbnail_size((int)(aud::max(w, h) * r));
+
+    auto img =
+        thumb ? thumbnail_request(filename, thumb) : art_request(filename);
     if (!img.isNull())
         return art_scale(img, w, h, want_hidpi);
 
@@ -213,7 +213,7 @@ void PresetView::add_imported(const Index<EqualizerPreset> & presets)
 
 static Index<EqualizerPreset> import_file(const char * filename)
 {
-    VFSFile file(filename, "r");
+    VFSFile file(filename, "rm");
     if (!file)
         return Index<EqualizerPreset>();
 